@@ -0,0 +1,819 @@
+/*
+ ============================================================================
+ Name        : bench.c
+ Description : Throughput benchmarks of the psych ingest and batch paths
+ Build       : cc -O3 bench.c -o bench -lm
+ Usage       : bench [-r reps] [-C cpu] [-j out.json] [-b base.json] [-t %] [rows]
+ ============================================================================
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include "psych.h"
+#include "psych_batch.h"
+#include "csvscan.h"
+
+#define BENCH_REPS 5		// default runs of each case, the fastest is reported
+#define BENCH_MAXREPS 100
+#define BENCH_MAXCASES 128
+#define BENCH_BATCH 256
+#define BENCH_EXACT 20		// largest sample of the exact rank test
+
+static volatile double sink;	// keeps results alive
+static int reps = BENCH_REPS;
+
+
+typedef struct
+{
+	char name[64];
+	double rows, bytes;
+	int n;
+	double sec[BENCH_MAXREPS];	// time of every run
+} bench_case;
+
+static bench_case results[BENCH_MAXCASES];
+static int nresults;
+
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1E-9 * t.tv_nsec;
+}
+
+
+static void report(const char *section, const char *name, const double *sec, double bytes, double rows)
+/*
+ * Prints the fastest of the reps runs in sec and keeps all of them for
+ * the JSON output and the baseline comparison
+ */
+{
+	bench_case *c = nresults < BENCH_MAXCASES ? &results[nresults++] : NULL;
+	double best = sec[0];
+	int k;
+
+	for(k = 1; k < reps; k++)
+	{
+		best = sec[k] < best ? sec[k] : best;
+	}
+	printf("%-32s %9.3f ms", name, 1E3 * best);
+	if(bytes > 0)
+	{
+		printf(" %8.2f GB/s", bytes / best / 1E9);
+	}
+	printf(" %8.1f Mrow/s\n", rows / best / 1E6);
+
+	if(c)
+	{
+		snprintf(c->name, sizeof(c->name), "%s/%s", section, name);
+		c->rows = rows;
+		c->bytes = bytes;
+		c->n = reps;
+		memcpy(c->sec, sec, sizeof(double) * reps);
+	}
+}
+
+
+/*
+ * CSV ingest
+ */
+
+static char *make_csv(long rows, int wide, size_t *len)
+/*
+ * A trend log in memory: timestamp, dry bulb [C], RH [Fraction], and with
+ * wide set five more points as a BAS export of an air handler would have
+ */
+{
+	char *s = malloc(rows * 96 + 1);
+	size_t n = 0;
+	long i;
+
+	srand(1);
+	for(i = 0; i < rows; i++)
+	{
+		double T = 22 + 12 * (rand() / (double)RAND_MAX - 0.5);
+		double RH = 0.3 + 0.5 * rand() / (double)RAND_MAX;
+		n += sprintf(s + n, "2024-%02ld-%02ld %02ld:%02ld:00,%.2f,%.3f", 1 + i / 44640 % 12, 1 + i / 1440 % 28,
+				i / 60 % 24, i % 60, T, RH);
+		if(wide)
+		{
+			n += sprintf(s + n, ",%.1f,%.2f,%d,%.1f,%.2f", 55.0 + i % 40, 12.8 + (i % 7) * 0.1, (int)(i % 2), 101.3, 0.45);
+		}
+		s[n++] = '\n';
+	}
+	*len = n;
+	return s;
+}
+
+
+static int strtod_field(const char *s, int len, int col, double *v)
+/*
+ * The scan and strtod() field parser trend.h used before csvscan.h,
+ * kept as the baseline
+ */
+{
+	int c = 0, i = 0, n;
+	char tmp[64];
+	char *end;
+
+	while(c < col)
+	{
+		while(i < len && s[i] != ',')
+		{
+			i++;
+		}
+		if(i >= len)
+		{
+			return -1;
+		}
+		i++;
+		c++;
+	}
+	for(n = 0; i + n < len && s[i + n] != ',' && n < 63; n++)
+	{
+		tmp[n] = s[i + n];
+	}
+	tmp[n] = 0;
+	*v = strtod(tmp, &end);
+	return end == tmp ? -1 : 0;
+}
+
+
+static long parse_strtod(const char *s, size_t len, double *Tdb, double *RH)
+{
+	size_t start = 0, i;
+	long rows = 0;
+	for(i = 0; i < len; i++)
+	{
+		if(s[i] == '\n')
+		{
+			int l = (int)(i - start);
+			if(strtod_field(s + start, l, 1, &Tdb[rows % BENCH_BATCH]) == 0
+					&& strtod_field(s + start, l, 2, &RH[rows % BENCH_BATCH]) == 0)
+			{
+				rows++;
+			}
+			start = i + 1;
+		}
+	}
+	return rows;
+}
+
+
+static long parse_fast(const char *s, size_t len, double *Tdb, double *RH, int psych)
+/*
+ * The csvscan.h path of trend.h; with psych set every full batch also goes
+ * through the humidity ratio, enthalpy and dew point kernels
+ */
+{
+	const char *p = s, *end = s + len, *nl;
+	double W[BENCH_BATCH], h[BENCH_BATCH], Tdp[BENCH_BATCH];
+	long rows = 0;
+	int pos[3], nb = 0;
+
+	while((nl = memchr(p, '\n', end - p)) != NULL)
+	{
+		int l = (int)(nl - p);
+		int npos = csv_split(p, l, ',', pos, 2);
+		if(csv_field(p, l, pos, npos, 1, &Tdb[nb]) == 0 && csv_field(p, l, pos, npos, 2, &RH[nb]) == 0)
+		{
+			rows++;
+			if(++nb == BENCH_BATCH)
+			{
+				if(psych)
+				{
+					hum_rat2_batch(Tdb, RH, 101.325, W, nb);
+					enthalpy_air_h2o_batch(Tdb, W, h, nb);
+					dew_point_batch(101.325, W, Tdp, nb);
+					sink += h[0] + Tdp[0];
+				}
+				nb = 0;
+			}
+		}
+		p = nl + 1;
+	}
+	return rows;
+}
+
+
+static void bench_csv(long rows, int wide)
+{
+	size_t len;
+	char *s = make_csv(rows, wide, &len);
+	double Tdb[BENCH_BATCH], RH[BENCH_BATCH];
+	double t[3][BENCH_MAXREPS];
+	const char *section = wide ? "csv8" : "csv3";
+	long got[3];
+	int r, k;
+
+	printf("\nCSV ingest, %s rows, %.1f MB\n", wide ? "8 column" : "3 column", len / 1E6);
+	for(r = 0; r < reps; r++)
+	{
+		for(k = 0; k < 3; k++)
+		{
+			double t0 = now();
+			got[k] = k == 0 ? parse_strtod(s, len, Tdb, RH) : parse_fast(s, len, Tdb, RH, k == 2);
+			t[k][r] = now() - t0;
+			sink += Tdb[0] + RH[0];
+		}
+	}
+	if(got[0] != got[1])
+	{
+		printf("row count mismatch %ld %ld\n", got[0], got[1]);
+	}
+	report(section, "strtod fields", t[0], len, got[0]);
+	report(section, "csvscan fields", t[1], len, got[1]);
+	report(section, "csvscan + W, h, Tdp kernels", t[2], len, got[2]);
+	free(s);
+}
+
+
+/*
+ * Record layouts
+ * A record of s doubles: timestamp, Tdb, RH, P, W, h, Tdp, then s - 7
+ * other points.  The kernels fill W, h and Tdp from Tdb, RH and P.
+ */
+
+#define REC_TDB 1
+#define REC_RH 2
+#define REC_P 3
+#define REC_W 4
+#define REC_H 5
+#define REC_TDP 6
+
+
+static void rec_soa(double *const *col, long n)
+/*
+ * Columns: the reference layout of the batch kernels
+ */
+{
+	long i;
+	for(i = 0; i < n; i += BENCH_BATCH)
+	{
+		int m = n - i < BENCH_BATCH ? (int)(n - i) : BENCH_BATCH;
+		hum_rat2_batch(col[REC_TDB] + i, col[REC_RH] + i, 101.325, col[REC_W] + i, m);
+		enthalpy_air_h2o_batch(col[REC_TDB] + i, col[REC_W] + i, col[REC_H] + i, m);
+		dew_point_batch(101.325, col[REC_W] + i, col[REC_TDP] + i, m);
+	}
+}
+
+
+static void rec_strided(double *r, int s, long n, int shared_p)
+/*
+ * Records processed in place by the strided kernels, with the pressure
+ * either read from each record or shared (stride 0)
+ */
+{
+	static const double P = 101.325;
+	const double *pp = shared_p ? &P : r + REC_P;
+	int ps = shared_p ? 0 : s;
+	long i;
+	for(i = 0; i < n; i += BENCH_BATCH)
+	{
+		int m = n - i < BENCH_BATCH ? (int)(n - i) : BENCH_BATCH;
+		double *b = r + i * s;
+		hum_rat2_strided(b + REC_TDB, s, b + REC_RH, s, pp + (shared_p ? 0 : i * s), ps, b + REC_W, s, m);
+		enthalpy_air_h2o_strided(b + REC_TDB, s, b + REC_W, s, b + REC_H, s, m);
+		dew_point_strided(pp + (shared_p ? 0 : i * s), ps, b + REC_W, s, b + REC_TDP, s, m);
+	}
+}
+
+
+static void rec_gather(double *r, int s, long n)
+/*
+ * Records copied into column blocks, run through the batch kernels and
+ * copied back: what the strided kernels avoid
+ */
+{
+	double Tdb[BENCH_BATCH], RH[BENCH_BATCH], W[BENCH_BATCH], h[BENCH_BATCH], Tdp[BENCH_BATCH];
+	long i;
+	int k;
+	for(i = 0; i < n; i += BENCH_BATCH)
+	{
+		int m = n - i < BENCH_BATCH ? (int)(n - i) : BENCH_BATCH;
+		double *b = r + i * s;
+		for(k = 0; k < m; k++)
+		{
+			Tdb[k] = b[k * s + REC_TDB];
+			RH[k] = b[k * s + REC_RH];
+		}
+		hum_rat2_batch(Tdb, RH, 101.325, W, m);
+		enthalpy_air_h2o_batch(Tdb, W, h, m);
+		dew_point_batch(101.325, W, Tdp, m);
+		for(k = 0; k < m; k++)
+		{
+			b[k * s + REC_W] = W[k];
+			b[k * s + REC_H] = h[k];
+			b[k * s + REC_TDP] = Tdp[k];
+		}
+	}
+}
+
+
+static void bench_records(long n, int s)
+{
+	double *r = malloc(sizeof(double) * n * s);
+	double *col[7];
+	double t[4][BENCH_MAXREPS];
+	char section[16];
+	long i;
+	int c, k, rep;
+
+	for(c = 0; c < 7; c++)
+	{
+		col[c] = malloc(sizeof(double) * n);
+	}
+	srand(2);
+	for(i = 0; i < n; i++)
+	{
+		double *b = r + i * s;
+		for(c = 0; c < s; c++)
+		{
+			b[c] = 0;
+		}
+		b[0] = (double)i;
+		b[REC_TDB] = col[REC_TDB][i] = 22 + 12 * (rand() / (double)RAND_MAX - 0.5);
+		b[REC_RH] = col[REC_RH][i] = 0.3 + 0.5 * rand() / (double)RAND_MAX;
+		b[REC_P] = col[REC_P][i] = 101.325;
+	}
+
+	printf("\nW, h, Tdp of %ld records of %d doubles (%d bytes)\n", n, s, 8 * s);
+	for(rep = 0; rep < reps; rep++)
+	{
+		for(k = 0; k < 4; k++)
+		{
+			double t0 = now();
+			switch(k)
+			{
+			case 0: rec_soa(col, n); break;
+			case 1: rec_strided(r, s, n, 1); break;
+			case 2: rec_strided(r, s, n, 0); break;
+			case 3: rec_gather(r, s, n); break;
+			}
+			t[k][rep] = now() - t0;
+		}
+	}
+	for(i = 0; i < n; i += n / 7 + 1)
+	{
+		if(fabs(r[i * s + REC_TDP] - col[REC_TDP][i]) > 1E-9)
+		{
+			printf("record %ld differs\n", i);
+		}
+	}
+	snprintf(section, sizeof(section), "rec%d", s);
+	report(section, "SoA columns", t[0], 0, n);
+	report(section, "strided, shared P", t[1], 0, n);
+	report(section, "strided, P per record", t[2], 0, n);
+	report(section, "gather / batch / scatter", t[3], 0, n);
+
+	for(c = 0; c < 7; c++)
+	{
+		free(col[c]);
+	}
+	free(r);
+}
+
+
+/*
+ * Single kernels, so a change to one equation shows up on its own
+ * Each run makes BENCH_PASSES passes, long enough to time the cheap ones.
+ */
+
+#define BENCH_PASSES 10
+
+static void bench_kernels(long n)
+{
+	double *T = malloc(sizeof(double) * n), *RH = malloc(sizeof(double) * n);
+	double *W = malloc(sizeof(double) * n), *out = malloc(sizeof(double) * n);
+	static const char *name[5] =
+	{
+		"sat_press_batch", "hum_rat2_batch", "enthalpy_air_h2o_batch", "dew_point_batch", "dry_air_density_batch"
+	};
+	double t[5][BENCH_MAXREPS];
+	long i;
+	int k, rep, pass;
+
+	srand(3);
+	for(i = 0; i < n; i++)
+	{
+		T[i] = 22 + 12 * (rand() / (double)RAND_MAX - 0.5);
+		RH[i] = 0.3 + 0.5 * rand() / (double)RAND_MAX;
+	}
+	hum_rat2_batch(T, RH, 101.325, W, (int)n);
+
+	printf("\nBatch kernels, %d passes over %ld values in blocks of %d\n", BENCH_PASSES, n, BENCH_BATCH);
+	for(rep = 0; rep < reps; rep++)
+	{
+		for(k = 0; k < 5; k++)
+		{
+			double t0 = now();
+			for(pass = 0; pass < BENCH_PASSES; pass++)
+			{
+				for(i = 0; i < n; i += BENCH_BATCH)
+				{
+					int m = n - i < BENCH_BATCH ? (int)(n - i) : BENCH_BATCH;
+					switch(k)
+					{
+					case 0: sat_press_batch(T + i, out + i, m); break;
+					case 1: hum_rat2_batch(T + i, RH + i, 101.325, out + i, m); break;
+					case 2: enthalpy_air_h2o_batch(T + i, W + i, out + i, m); break;
+					case 3: dew_point_batch(101.325, W + i, out + i, m); break;
+					case 4: dry_air_density_batch(101.325, T + i, W + i, out + i, m); break;
+					}
+				}
+			}
+			t[k][rep] = now() - t0;
+			sink += out[n / 2];
+		}
+	}
+	for(k = 0; k < 5; k++)
+	{
+		report("kernel", name[k], t[k], 0, (double)BENCH_PASSES * n);
+	}
+	free(T);
+	free(RH);
+	free(W);
+	free(out);
+}
+
+
+/*
+ * psych() by input and output type, IP units
+ */
+
+static void bench_paths(long n)
+{
+	static const int in[5] = {1, 2, 3, 4, 7};
+	static const int out[9] = {1, 2, 3, 4, 5, 6, 7, 9, 10};
+	double *T = malloc(sizeof(double) * n), *v = malloc(sizeof(double) * n * 5);
+	double t[BENCH_MAXREPS];
+	long i;
+	int a, b, rep;
+
+	srand(4);
+	for(i = 0; i < n; i++)
+	{
+		double u = rand() / (double)RAND_MAX;
+		T[i] = 60 + 35 * u;
+		v[5 * i] = T[i] - 5 - 10 * u;					// wet bulb [F]
+		v[5 * i + 1] = 40 + 15 * u;						// dew point [F]
+		v[5 * i + 2] = 0.3 + 0.5 * u;					// RH
+		v[5 * i + 3] = 0.004 + 0.008 * u;				// W
+		v[5 * i + 4] = 20 + 15 * u;						// h [Btu/lb]
+	}
+
+	printf("\npsych() paths, %ld calls each\n", n);
+	for(a = 0; a < 5; a++)
+	{
+		for(b = 0; b < 9; b++)
+		{
+			char name[32];
+			for(rep = 0; rep < reps; rep++)
+			{
+				double t0 = now(), acc = 0;
+				for(i = 0; i < n; i++)
+				{
+					acc += psych(14.696, T[i], v[5 * i + a], in[a], out[b], 0);
+				}
+				t[rep] = now() - t0;
+				sink += acc;
+			}
+			snprintf(name, sizeof(name), "in %d out %d", in[a], out[b]);
+			report("psych", name, t, 0, n);
+		}
+	}
+	free(T);
+	free(v);
+}
+
+
+/*
+ * Results as JSON, one case per line so the baseline reader stays simple
+ */
+
+static int write_json(const char *path, long rows)
+{
+	FILE *f = fopen(path, "w");
+	int i, k;
+
+	if(!f)
+	{
+		return -1;
+	}
+	fprintf(f, "{\"rows\": %ld, \"reps\": %d, \"cases\": [\n", rows, reps);
+	for(i = 0; i < nresults; i++)
+	{
+		const bench_case *c = &results[i];
+		fprintf(f, "{\"name\": \"%s\", \"rows\": %.0f, \"bytes\": %.0f, \"sec\": [", c->name, c->rows, c->bytes);
+		for(k = 0; k < c->n; k++)
+		{
+			fprintf(f, "%s%.9g", k ? ", " : "", c->sec[k]);
+		}
+		fprintf(f, "]}%s\n", i < nresults - 1 ? "," : "");
+	}
+	fprintf(f, "]}\n");
+	return fclose(f);
+}
+
+
+static int read_json(const char *path, bench_case *base, int max, long *rows, int *nreps)
+/*
+ * Reads the cases of a file written by write_json(), and the row count
+ * and runs per case it was recorded with (0 if the file lacks them)
+ * Returns the number read, -1 if the file cannot be opened
+ */
+{
+	FILE *f = fopen(path, "r");
+	char line[4096];
+	int n = 0;
+
+	if(!f)
+	{
+		return -1;
+	}
+	*rows = 0;
+	*nreps = 0;
+	while(n < max && fgets(line, sizeof(line), f))
+	{
+		bench_case *c = &base[n];
+		char *p = strstr(line, "\"name\": \""), *q;
+		if(!p)
+		{
+			sscanf(line, "{\"rows\": %ld, \"reps\": %d", rows, nreps);	// the header line
+			continue;
+		}
+		if(!(q = strchr(p + 9, '"')) || q - p - 9 >= (int)sizeof(c->name))
+		{
+			continue;
+		}
+		memcpy(c->name, p + 9, q - p - 9);
+		c->name[q - p - 9] = 0;
+		c->rows = (p = strstr(q, "\"rows\": ")) ? strtod(p + 8, NULL) : 0;
+		if(!(p = strstr(q, "\"sec\": [")))
+		{
+			continue;
+		}
+		p += 8;
+		for(c->n = 0; c->n < BENCH_MAXREPS; c->n++)
+		{
+			c->sec[c->n] = strtod(p, &q);
+			if(q == p)
+			{
+				break;
+			}
+			p = q + strspn(q, ", ");
+		}
+		n += c->n > 0;
+	}
+	fclose(f);
+	return n;
+}
+
+
+static double median(const double *x, int n)
+{
+	double y[BENCH_MAXREPS], v;
+	int i, j;
+	for(i = 0; i < n; i++)
+	{
+		for(v = x[i], j = i; j > 0 && y[j - 1] > v; j--)
+		{
+			y[j] = y[j - 1];
+		}
+		y[j] = v;
+	}
+	return n % 2 ? y[n / 2] : (y[n / 2 - 1] + y[n / 2]) / 2;
+}
+
+
+static double mw_exact(int nx, int ny, int u)
+/*
+ * Two sided p value of U = u under the exact null distribution, counting
+ * the orderings of nx x and ny y values with f(i, j, k) = f(i - 1, j, k - j)
+ * + f(i, j - 1, k): the largest value is an x above all j y values, or a y
+ */
+{
+	static double f[2][BENCH_EXACT + 1][BENCH_EXACT * BENCH_EXACT + 1];
+	double lo = 0, hi = 0, total = 0;
+	int i, j, k, cur = 0;
+
+	for(i = 0; i <= nx; i++)
+	{
+		cur = i & 1;
+		for(j = 0; j <= ny; j++)
+		{
+			for(k = 0; k <= nx * ny; k++)
+			{
+				f[cur][j][k] = i == 0 || j == 0 ? k == 0
+						: (k >= j ? f[!cur][j][k - j] : 0) + f[cur][j - 1][k];
+			}
+		}
+	}
+	for(k = 0; k <= nx * ny; k++)
+	{
+		total += f[cur][ny][k];
+		lo += k <= u ? f[cur][ny][k] : 0;
+		hi += k >= u ? f[cur][ny][k] : 0;
+	}
+	return fmin(1, 2 * fmin(lo, hi) / total);
+}
+
+
+static double mann_whitney(const double *x, int nx, const double *y, int ny)
+/*
+ * Two sided p value of the Mann-Whitney U test that x and y come from the
+ * same distribution: exact for samples of up to BENCH_EXACT runs without
+ * ties, else by the normal approximation with the tie corrected variance
+ * Run times are skewed by interrupts and frequency changes, so a rank
+ * test suits them better than a t test.
+ */
+{
+	double u = 0, mu = nx * ny / 2.0, ties = 0, sd;
+	int i, j, n = nx + ny;
+
+	for(i = 0; i < nx; i++)
+	{
+		for(j = 0; j < ny; j++)
+		{
+			u += x[i] > y[j] ? 1 : x[i] == y[j] ? 0.5 : 0;
+		}
+	}
+	// sum of t^3 - t over groups of t equal values in the pooled sample
+	for(i = 0; i < n; i++)
+	{
+		double v = i < nx ? x[i] : y[i - nx];
+		int t = 0, first = 1;
+		for(j = 0; j < n; j++)
+		{
+			double w = j < nx ? x[j] : y[j - nx];
+			t += w == v;
+			first = first && !(w == v && j < i);
+		}
+		ties += first ? (double)t * t * t - t : 0;
+	}
+	if(ties == 0 && nx <= BENCH_EXACT && ny <= BENCH_EXACT)
+	{
+		return mw_exact(nx, ny, (int)u);
+	}
+	sd = sqrt(nx * ny / 12.0 * ((n + 1) - ties / ((double)n * (n - 1))));
+	return sd > 0 ? erfc(fabs(u - mu) / sd / sqrt(2)) : 1;
+}
+
+
+static int compare(const char *path, long rows, double threshold, double alpha)
+/*
+ * Compares this run of rows rows with a baseline file
+ * A case regresses when its median time grew by more than threshold and
+ * the rank test rejects equal distributions at level alpha.  Times do not
+ * scale linearly with rows once the data leaves cache, so a baseline
+ * recorded at another row count is refused rather than normalised.
+ * Returns the number of regressions, -1 if the baseline is unreadable,
+ * -2 if it was recorded at another row count
+ */
+{
+	static bench_case base[BENCH_MAXCASES];
+	long base_rows;
+	int base_reps, nb = read_json(path, base, BENCH_MAXCASES, &base_rows, &base_reps), i, k, bad = 0;
+	double least;
+
+	if(nb < 0)
+	{
+		return -1;
+	}
+	if(base_rows != rows)
+	{
+		fprintf(stderr, "%s was recorded with %ld rows, this run has %ld; rerun with bench %ld\n",
+				path, base_rows, rows, base_rows);
+		return -2;
+	}
+	printf("\nAgainst %s (median change, Mann-Whitney p, %.0f%% threshold, alpha %g)\n", path, 100 * threshold, alpha);
+	for(i = 0; i < nresults; i++)
+	{
+		const bench_case *c = &results[i];
+		for(k = 0; k < nb && strcmp(base[k].name, c->name) != 0; k++)
+		{
+		}
+		if(k == nb)
+		{
+			printf("%-44s new\n", c->name);
+			continue;
+		}
+		if(base[k].rows != c->rows)
+		{
+			printf("%-44s rows differ, not compared\n", c->name);
+			continue;
+		}
+		{
+			double mb = median(base[k].sec, base[k].n), mc = median(c->sec, c->n);
+			double change = mc / mb - 1, p = mann_whitney(c->sec, c->n, base[k].sec, base[k].n);
+			const char *verdict = "";
+			if(p < alpha && change > threshold)
+			{
+				verdict = "REGRESSION";
+				bad++;
+			}
+			else if(p < alpha && change < -threshold)
+			{
+				verdict = "faster";
+			}
+			printf("%-44s %+7.1f%%  p %.4f  %s\n", c->name, 100 * change, p, verdict);
+		}
+	}
+	// Smallest p value the test can give: 2 / C(reps + base_reps, reps)
+	for(least = 2, k = 1; k <= reps && base_reps > 0; k++)
+	{
+		least *= (double)k / (base_reps + k);
+	}
+	if(base_reps > 0 && least >= alpha)
+	{
+		printf("note: with %d and %d runs per case no p value falls below %.3g, use -r 10 or more\n",
+				reps, base_reps, least);
+	}
+	return bad;
+}
+
+
+static void check_cpu(int cpu)
+/*
+ * Pins the process to one CPU if asked and warns about frequency scaling
+ */
+{
+	FILE *f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", "r");
+	char gov[64];
+
+	if(cpu >= 0)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if(sched_setaffinity(0, sizeof(set), &set) != 0)
+		{
+			perror("sched_setaffinity");
+		}
+	}
+	if(f && fgets(gov, sizeof(gov), f) && strncmp(gov, "performance", 11) != 0)
+	{
+		fprintf(stderr, "note: CPU governor is %.*s, results vary with frequency;"
+				" see README for pinning\n", (int)strcspn(gov, "\n"), gov);
+	}
+	if(f)
+	{
+		fclose(f);
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *json = NULL, *baseline = NULL;
+	double threshold = 0.05;
+	long rows;
+	int opt, cpu = -1, bad = 0;
+
+	while((opt = getopt(argc, argv, "r:C:j:b:t:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'r': reps = atoi(optarg); break;
+		case 'C': cpu = atoi(optarg); break;
+		case 'j': json = optarg; break;
+		case 'b': baseline = optarg; break;
+		case 't': threshold = atof(optarg) / 100; break;
+		default:
+			fprintf(stderr, "usage: bench [-r reps] [-C cpu] [-j out.json] [-b base.json] [-t %%] [rows]\n");
+			return 2;
+		}
+	}
+	reps = reps < 1 ? 1 : reps > BENCH_MAXREPS ? BENCH_MAXREPS : reps;
+	rows = optind < argc ? atol(argv[optind]) : 1000000;
+	check_cpu(cpu);
+
+	printf("psych benchmarks, best of %d runs\n", reps);
+	bench_csv(rows, 0);
+	bench_csv(rows, 1);
+	bench_records(rows, 7);
+	bench_records(rows, 16);
+	bench_kernels(rows);
+	bench_paths(rows / 4 > 0 ? rows / 4 : 1);
+
+	if(json && write_json(json, rows) != 0)
+	{
+		perror(json);
+		return 2;
+	}
+	if(baseline && (bad = compare(baseline, rows, threshold, 0.01)) < 0)
+	{
+		if(bad == -1)
+		{
+			perror(baseline);
+		}
+		return 2;
+	}
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * chartbin.h
+ *
+ * Joint distribution binning of weather hours on the psych chart.
+ *
+ * Hours are counted in a 2D grid of dry bulb against humidity ratio or
+ * enthalpy.  States are computed in batches, bin indexes are computed for
+ * a whole batch in a branch free loop, and chartbin_add_parallel() gives
+ * each thread its own grid and sums the grids at the end.
+ *
+ */
+
+#ifndef CHARTBIN_H
+#define CHARTBIN_H
+#include <stdlib.h>
+#include <math.h>
+#include "psych.h"
+#include "psych_batch.h"
+
+#define CHARTBIN_Y_W 4	// y axis is humidity ratio, as outType 4 of psych()
+#define CHARTBIN_Y_H 7	// y axis is enthalpy, as outType 7 of psych()
+#define CHARTBIN_CHUNK 256	// hours per batch call
+
+
+typedef struct
+{
+	int yType;		// CHARTBIN_Y_W or CHARTBIN_Y_H
+	double x0;		// lower edge of the first dry bulb bin [degC]
+	double dx;		// dry bulb bin width [degC]
+	int nx;
+	double y0;		// lower edge of the first y bin [kg/kg or kJ/kg]
+	double dy;		// y bin width
+	int ny;
+	long *count;	// nx * ny hours, bin (ix, iy) at count[iy * nx + ix]
+	long outside;	// hours that fell off the grid or were missing
+} chartbin;
+
+
+int chartbin_init(chartbin *b, int yType, double x0, double dx, int nx, double y0, double dy, int ny)
+/*
+ * Allocates an empty grid
+ * e.g. chartbin_init(&b, CHARTBIN_Y_W, -30, 1, 80, 0, 0.001, 30) bins
+ * -30 to 50 degC by 1 degC and 0 to 30 g/kg by 1 g/kg
+ * Returns 0 on success, -1 on bad arguments or out of memory
+ */
+{
+	b->count = NULL;
+	b->outside = 0;
+	if(nx < 1 || ny < 1 || dx <= 0 || dy <= 0 || (yType != CHARTBIN_Y_W && yType != CHARTBIN_Y_H))
+	{
+		return -1;
+	}
+	b->yType = yType;
+	b->x0 = x0;
+	b->dx = dx;
+	b->nx = nx;
+	b->y0 = y0;
+	b->dy = dy;
+	b->ny = ny;
+	b->count = calloc((size_t)nx * ny, sizeof(long));
+	return b->count ? 0 : -1;
+}
+
+
+void chartbin_free(chartbin *b)
+/*
+ * Releases the grid
+ */
+{
+	free(b->count);
+	b->count = NULL;
+}
+
+
+void chartbin_index(const chartbin *b, const double *restrict Tdb, const double *restrict y,
+		int *restrict idx, int n)
+/*
+ * Computes the flat bin index of n states, -1 when off the grid or NaN
+ */
+{
+	int i;
+	double rx = 1 / b->dx, ry = 1 / b->dy;
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		double fx = floor((Tdb[i] - b->x0) * rx);
+		double fy = floor((y[i] - b->y0) * ry);
+		int ok = fx >= 0 && fx < b->nx && fy >= 0 && fy < b->ny;	// false for NaN
+		idx[i] = ok ? (int)fy * b->nx + (int)fx : -1;
+	}
+}
+
+
+void chartbin_add(chartbin *b, const double *Tdb, const double *RH, double P, int n)
+/*
+ * Bins n hourly readings
+ * Tdb = dry bulb temperatures [degC]
+ * RH = relative humidities [Fraction]
+ * P = station pressure [kPa]
+ */
+{
+	int i, k, m;
+	int idx[CHARTBIN_CHUNK];
+	double W[CHARTBIN_CHUNK], h[CHARTBIN_CHUNK];
+	double *y = W;
+
+	for(i = 0; i < n; i += CHARTBIN_CHUNK)
+	{
+		m = n - i < CHARTBIN_CHUNK ? n - i : CHARTBIN_CHUNK;
+		hum_rat2_batch(Tdb + i, RH + i, P, W, m);
+		if(b->yType == CHARTBIN_Y_H)
+		{
+			enthalpy_air_h2o_batch(Tdb + i, W, h, m);
+			y = h;
+		}
+		chartbin_index(b, Tdb + i, y, idx, m);
+		for(k = 0; k < m; k++)
+		{
+			if(idx[k] < 0)
+			{
+				b->outside++;
+			}
+			else
+			{
+				b->count[idx[k]]++;
+			}
+		}
+	}
+}
+
+
+int chartbin_merge(chartbin *b, const chartbin *other)
+/*
+ * Adds the counts of a grid with the same layout into b
+ * Returns 0 on success, -1 if the layouts differ
+ */
+{
+	size_t i, cells = (size_t)b->nx * b->ny;
+	if(other->nx != b->nx || other->ny != b->ny || other->yType != b->yType
+			|| other->x0 != b->x0 || other->dx != b->dx || other->y0 != b->y0 || other->dy != b->dy)
+	{
+		return -1;
+	}
+	for(i = 0; i < cells; i++)
+	{
+		b->count[i] += other->count[i];
+	}
+	b->outside += other->outside;
+	return 0;
+}
+
+
+int chartbin_add_parallel(chartbin *b, const double *Tdb, const double *RH, const double *P,
+		int ns, int nh)
+/*
+ * Bins ns stations of nh hours each into b
+ * Tdb, RH = ns * nh hourly readings, station s starting at s * nh
+ * P = ns station pressures [kPa]
+ * With -fopenmp each thread fills a private grid; the grids are summed
+ * once at the end so there is no contention on the shared counts.
+ * Returns 0 on success, -1 if a thread grid could not be allocated
+ */
+{
+	int err = 0;
+	#pragma omp parallel
+	{
+		int s;
+		chartbin local;
+		int ok = chartbin_init(&local, b->yType, b->x0, b->dx, b->nx, b->y0, b->dy, b->ny) == 0;
+
+		#pragma omp for schedule(dynamic, 1)
+		for(s = 0; s < ns; s++)
+		{
+			if(ok)
+			{
+				chartbin_add(&local, Tdb + (size_t)s * nh, RH + (size_t)s * nh, P[s], nh);
+			}
+		}
+
+		#pragma omp critical
+		{
+			if(ok)
+			{
+				chartbin_merge(b, &local);
+			}
+			else
+			{
+				err = -1;
+			}
+		}
+		chartbin_free(&local);
+	}
+	return err;
+}
+
+
+#endif
@@ -0,0 +1,392 @@
+/*
+ * colfile.h
+ *
+ * Columnar result files.
+ *
+ * Rows of doubles are buffered and written in blocks of COL_BLOCK rows,
+ * each block storing one column after the other, so a reader that wants
+ * a few columns of a large result reads them as contiguous arrays.
+ *
+ * Every block starts with a zone map, the min and max of each column in
+ * the block.  col_scan() checks a query's ranges against the zone map and
+ * seeks past blocks that cannot match, so a filter such as "supply dew
+ * point above 12.8 C" over years of data reads only the blocks that hold
+ * such hours.
+ *
+ * Layout (native byte order):
+ *   "PSYCOL02", int32 ncols, ncols names of COL_NAME bytes
+ *   then blocks of: int32 nrows, ncols (min, max) pairs,
+ *                   ncols * nrows doubles, column major
+ * Files written before zone maps ("PSYCOL01") have no min / max pairs
+ * and are still read; col_scan() then reads every block.
+ *
+ */
+
+#ifndef COLFILE_H
+#define COLFILE_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define COL_NAME 32			// bytes per column name, including the terminator
+#define COL_BLOCK 4096		// rows per block
+#define COL_MAXCOLS 256
+#define COL_MAGIC "PSYCOL02"
+#define COL_MAGIC_V1 "PSYCOL01"
+
+
+typedef struct
+{
+	FILE *f;
+	int ncols;
+	int nrows;						// rows buffered in the current block
+	char name[COL_MAXCOLS][COL_NAME];
+	double *buf;					// ncols * COL_BLOCK, column c at buf + c * COL_BLOCK
+	int zonemap;					// blocks carry min / max pairs
+	double min[COL_MAXCOLS];		// zone map of the current block
+	double max[COL_MAXCOLS];
+	long blocks_read;				// blocks whose data was read by col_scan()
+	long blocks_skipped;			// blocks col_scan() skipped from the zone map
+} col_file;
+
+
+typedef struct
+{
+	int col;		// column index, see col_find()
+	double lo;		// lowest accepted value, -HUGE_VAL for no lower bound
+	double hi;		// highest accepted value, HUGE_VAL for no upper bound
+} col_pred;
+
+
+/*
+ * Called by col_scan() for each matching row
+ * r = the file, column c of the row is r->buf[c * COL_BLOCK + i]
+ * Return non zero to stop the scan.
+ */
+typedef int (*col_row_fn)(const col_file *r, int i, void *ctx);
+
+
+col_file *col_create(const char *path, int ncols, const char *const *names)
+/*
+ * Creates a result file with ncols named columns
+ * Returns NULL on bad arguments or I/O error
+ */
+{
+	int c;
+	int32_t n = ncols;
+	col_file *w;
+
+	if(ncols < 1 || ncols > COL_MAXCOLS)
+	{
+		return NULL;
+	}
+	w = calloc(1, sizeof(col_file));
+	if(!w)
+	{
+		return NULL;
+	}
+	w->buf = malloc(sizeof(double) * ncols * COL_BLOCK);
+	w->f = fopen(path, "wb");
+	if(!w->buf || !w->f)
+	{
+		if(w->f)
+		{
+			fclose(w->f);
+		}
+		free(w->buf);
+		free(w);
+		return NULL;
+	}
+	w->ncols = ncols;
+	w->zonemap = 1;
+	for(c = 0; c < ncols; c++)
+	{
+		strncpy(w->name[c], names[c], COL_NAME - 1);
+	}
+	fwrite(COL_MAGIC, 1, 8, w->f);
+	fwrite(&n, sizeof(n), 1, w->f);
+	fwrite(w->name, COL_NAME, ncols, w->f);
+	return w;
+}
+
+
+int col_flush(col_file *w)
+/*
+ * Writes the buffered rows as one block, preceded by its zone map
+ * NaN values are left out of the min / max; an all NaN column gets
+ * min = HUGE_VAL and max = -HUGE_VAL, which no range query matches.
+ * Returns 0 on success, -1 on I/O error
+ */
+{
+	int c, i;
+	int32_t n = w->nrows;
+	double mm[2];
+
+	if(w->nrows == 0)
+	{
+		return 0;
+	}
+	if(fwrite(&n, sizeof(n), 1, w->f) != 1)
+	{
+		return -1;
+	}
+	for(c = 0; c < w->ncols; c++)
+	{
+		const double *x = w->buf + (size_t)c * COL_BLOCK;
+		mm[0] = HUGE_VAL;
+		mm[1] = -HUGE_VAL;
+		for(i = 0; i < n; i++)
+		{
+			mm[0] = fmin(mm[0], x[i]);
+			mm[1] = fmax(mm[1], x[i]);
+		}
+		if(fwrite(mm, sizeof(double), 2, w->f) != 2)
+		{
+			return -1;
+		}
+	}
+	for(c = 0; c < w->ncols; c++)
+	{
+		if(fwrite(w->buf + (size_t)c * COL_BLOCK, sizeof(double), n, w->f) != (size_t)n)
+		{
+			return -1;
+		}
+	}
+	w->nrows = 0;
+	return 0;
+}
+
+
+int col_append(col_file *w, const double *row)
+/*
+ * Appends one row of ncols values
+ * Returns 0 on success, -1 on I/O error
+ */
+{
+	int c;
+	for(c = 0; c < w->ncols; c++)
+	{
+		w->buf[(size_t)c * COL_BLOCK + w->nrows] = row[c];
+	}
+	if(++w->nrows == COL_BLOCK)
+	{
+		return col_flush(w);
+	}
+	return 0;
+}
+
+
+int col_close(col_file *w)
+/*
+ * Flushes, closes and frees a file opened with col_create() or col_open()
+ * Returns 0 on success, -1 on I/O error
+ */
+{
+	int err = 0;
+	if(!w)
+	{
+		return -1;
+	}
+	if(w->nrows && w->f)
+	{
+		err = col_flush(w);
+	}
+	if(w->f && fclose(w->f) != 0)
+	{
+		err = -1;
+	}
+	free(w->buf);
+	free(w);
+	return err;
+}
+
+
+col_file *col_open(const char *path)
+/*
+ * Opens a result file for reading
+ * Returns NULL if the file is missing or not a result file
+ */
+{
+	char magic[8];
+	int32_t n;
+	col_file *r = calloc(1, sizeof(col_file));
+
+	if(!r)
+	{
+		return NULL;
+	}
+	r->f = fopen(path, "rb");
+	if(!r->f || fread(magic, 1, 8, r->f) != 8
+			|| (memcmp(magic, COL_MAGIC, 8) != 0 && memcmp(magic, COL_MAGIC_V1, 8) != 0)
+			|| fread(&n, sizeof(n), 1, r->f) != 1 || n < 1 || n > COL_MAXCOLS
+			|| fread(r->name, COL_NAME, n, r->f) != (size_t)n)
+	{
+		if(r->f)
+		{
+			fclose(r->f);
+		}
+		free(r);
+		return NULL;
+	}
+	r->ncols = n;
+	r->zonemap = memcmp(magic, COL_MAGIC, 8) == 0;
+	r->buf = malloc(sizeof(double) * n * COL_BLOCK);
+	if(!r->buf)
+	{
+		fclose(r->f);
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+
+int col_read_header(col_file *r)
+/*
+ * Reads the row count and zone map of the next block, leaving the file at
+ * its data.  Without zone maps min / max are set to -HUGE_VAL / HUGE_VAL.
+ * Returns the number of rows in the block, 0 at end of file, -1 on a bad block
+ */
+{
+	int c;
+	int32_t n;
+	double mm[2];
+
+	if(fread(&n, sizeof(n), 1, r->f) != 1)
+	{
+		return 0;
+	}
+	if(n < 1 || n > COL_BLOCK)
+	{
+		return -1;
+	}
+	for(c = 0; c < r->ncols; c++)
+	{
+		mm[0] = -HUGE_VAL;
+		mm[1] = HUGE_VAL;
+		if(r->zonemap && fread(mm, sizeof(double), 2, r->f) != 2)
+		{
+			return -1;
+		}
+		r->min[c] = mm[0];
+		r->max[c] = mm[1];
+	}
+	return n;
+}
+
+
+int col_read_data(col_file *r, int n)
+/*
+ * Reads the data of a block whose header was just read
+ * Returns n on success, -1 on a short block
+ */
+{
+	int c;
+	for(c = 0; c < r->ncols; c++)
+	{
+		if(fread(r->buf + (size_t)c * COL_BLOCK, sizeof(double), n, r->f) != (size_t)n)
+		{
+			return -1;
+		}
+	}
+	return n;
+}
+
+
+int col_read_block(col_file *r)
+/*
+ * Reads the next block; column c is then at r->buf + c * COL_BLOCK and
+ * its zone map in r->min[c], r->max[c]
+ * Returns the number of rows read, 0 at end of file, -1 on a bad block
+ * A reader's nrows stays 0, so col_close() never writes to it.
+ */
+{
+	int n = col_read_header(r);
+	return n > 0 ? col_read_data(r, n) : n;
+}
+
+
+long col_scan(col_file *r, const col_pred *pred, int npred, col_row_fn fn, void *ctx)
+/*
+ * Finds the rows where every predicate holds (lo <= value <= hi)
+ * Blocks whose zone map excludes any predicate are skipped without
+ * reading their data; r->blocks_read and r->blocks_skipped count both.
+ * fn = called for each matching row, may be NULL to only count
+ * Returns the number of matching rows, or -1 on a bad block or predicate
+ */
+{
+	long hits = 0;
+	int n, i, k;
+
+	for(k = 0; k < npred; k++)
+	{
+		if(pred[k].col < 0 || pred[k].col >= r->ncols)
+		{
+			return -1;
+		}
+	}
+
+	while((n = col_read_header(r)) > 0)
+	{
+		int skip = 0;
+		for(k = 0; k < npred && !skip; k++)
+		{
+			skip = r->max[pred[k].col] < pred[k].lo || r->min[pred[k].col] > pred[k].hi;
+		}
+		if(skip)
+		{
+			r->blocks_skipped++;
+			if(fseek(r->f, (long)sizeof(double) * n * r->ncols, SEEK_CUR) != 0)
+			{
+				return -1;
+			}
+			continue;
+		}
+
+		if(col_read_data(r, n) < 0)
+		{
+			return -1;
+		}
+		r->blocks_read++;
+		for(i = 0; i < n; i++)
+		{
+			int ok = 1;
+			for(k = 0; k < npred && ok; k++)
+			{
+				double v = r->buf[(size_t)pred[k].col * COL_BLOCK + i];
+				ok = v >= pred[k].lo && v <= pred[k].hi;
+			}
+			if(ok)
+			{
+				hits++;
+				if(fn && fn(r, i, ctx))
+				{
+					return hits;
+				}
+			}
+		}
+	}
+	return n < 0 ? -1 : hits;
+}
+
+
+int col_find(const col_file *f, const char *name)
+/*
+ * Index of a column by name, -1 if absent
+ */
+{
+	int c;
+	for(c = 0; c < f->ncols; c++)
+	{
+		if(strncmp(f->name[c], name, COL_NAME) == 0)
+		{
+			return c;
+		}
+	}
+	return -1;
+}
+
+
+#endif
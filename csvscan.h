@@ -0,0 +1,201 @@
+/*
+ * csvscan.h
+ *
+ * Fast field splitting and number parsing for CSV trend logs.
+ *
+ * Converting text to doubles costs more than the psych math on a trend
+ * log, so the ingest path avoids strtod() for the common case.
+ * csv_atof() accumulates up to 19 significant digits in an integer and,
+ * when the mantissa fits in 53 bits and the decimal exponent is within
+ * +-22, scales it by one exact power of ten.  Both operands are then exact
+ * doubles and IEEE division / multiplication rounds once, so the result is
+ * the correctly rounded value (Clinger's fast path), the same as strtod().
+ * Anything else (long mantissas, large exponents, inf, nan) goes to
+ * strtod().  csv_split() finds the delimiters of a line 16 bytes at a time
+ * with SSE2 compares where available.
+ *
+ */
+
+#ifndef CSVSCAN_H
+#define CSVSCAN_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CSV_MAXFIELD 64		// fields csv_atof() hands to strtod() from the stack, longer ones are copied to the heap
+
+
+const double csv_pow10[23] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+int csv_split(const char *s, int len, char delim, int *pos, int max)
+/*
+ * Offsets of the first max delimiters of a line of len bytes
+ * Returns the number found; field c then runs from pos[c - 1] + 1 (0 for
+ * the first field) to pos[c] (len for the last field)
+ */
+{
+	int i = 0, n = 0;
+
+#ifdef __SSE2__
+	__m128i d = _mm_set1_epi8(delim);
+	for(; i + 16 <= len && n < max; i += 16)
+	{
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)), d));
+		while(mask && n < max)
+		{
+			pos[n++] = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for(; i < len && n < max; i++)
+	{
+		if(s[i] == delim)
+		{
+			pos[n++] = i;
+		}
+	}
+	return n;
+}
+
+
+const char *csv_atof(const char *s, const char *end, double *v)
+/*
+ * Parses a decimal number from s, reading no further than end
+ * Accepts what strtod() accepts for decimal input: leading white space,
+ * a sign, digits with an optional point and an optional exponent.
+ * Returns the first byte after the number, or NULL if there is none.
+ */
+{
+	const char *p = s, *q;
+	uint64_t m = 0;
+	int digits = 0, exp10 = 0, neg = 0, any = 0;
+
+	while(p < end && isspace((unsigned char)*p))
+	{
+		p++;
+	}
+	q = p;
+	if(p < end && (*p == '-' || *p == '+'))
+	{
+		neg = *p++ == '-';
+	}
+
+	for(; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		any = 1;
+		if(m == 0 && *p == '0')
+		{
+			continue;		// leading zeros are not significant
+		}
+		if(digits < 19)
+		{
+			m = 10 * m + (*p - '0');
+		}
+		else
+		{
+			exp10++;
+		}
+		digits += m != 0;
+	}
+	if(p < end && *p == '.')
+	{
+		for(p++; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			any = 1;
+			if(m == 0 && *p == '0')
+			{
+				exp10--;
+				continue;
+			}
+			if(digits < 19)
+			{
+				m = 10 * m + (*p - '0');
+				exp10--;
+			}
+			digits++;
+		}
+	}
+	if(!any || (p < end && (*p == 'x' || *p == 'X')))
+	{
+		goto slow;		// inf, nan, hex or no number at all
+	}
+	if(p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char *e = p + 1;
+		int eneg = 0, ev = 0;
+		if(e < end && (*e == '-' || *e == '+'))
+		{
+			eneg = *e++ == '-';
+		}
+		if(e < end && *e >= '0' && *e <= '9')
+		{
+			for(; e < end && *e >= '0' && *e <= '9'; e++)
+			{
+				ev = ev < 10000 ? 10 * ev + (*e - '0') : ev;
+			}
+			exp10 += eneg ? -ev : ev;
+			p = e;
+		}
+	}
+
+	if(digits > 19 || m > ((uint64_t)1 << 53) || exp10 < -22 || exp10 > 22)
+	{
+		goto slow;
+	}
+	*v = exp10 < 0 ? (double)m / csv_pow10[-exp10] : (double)m * csv_pow10[exp10];
+	if(neg)
+	{
+		*v = -*v;
+	}
+	return p;
+
+slow:
+	{
+		// strtod() needs a terminated copy; the whole field, however long
+		char tmp[CSV_MAXFIELD], *buf = tmp, *stop;
+		size_t n = end - q;
+		if(n >= CSV_MAXFIELD && !(buf = malloc(n + 1)))
+		{
+			return NULL;
+		}
+		memcpy(buf, q, n);
+		buf[n] = 0;
+		*v = strtod(buf, &stop);
+		p = stop == buf ? NULL : q + (stop - buf);
+		if(buf != tmp)
+		{
+			free(buf);
+		}
+		return p;
+	}
+}
+
+
+int csv_field(const char *s, int len, const int *pos, int npos, int col, double *v)
+/*
+ * Parses column col of a line split by csv_split()
+ * Returns 0 on success, -1 if the column is missing or not a number
+ */
+{
+	const char *a, *b;
+	if(col < 0 || col > npos)
+	{
+		return -1;
+	}
+	a = s + (col ? pos[col - 1] + 1 : 0);
+	b = s + (col < npos ? pos[col] : len);
+	return csv_atof(a, b, v) ? 0 : -1;
+}
+
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * degday.h
+ *
+ * Degree-day, enthalpy-hour and latent load index calculator.
+ *
+ * One pass over an hourly weather array fills a matrix of results with
+ * one row per base point, so a whole set of balance points is evaluated
+ * for the cost of one psychrometric evaluation per hour.  degday_stations()
+ * repeats this over many stations and is parallel when built with -fopenmp.
+ *
+ */
+
+#ifndef DEGDAY_H
+#define DEGDAY_H
+#include <stdlib.h>
+#include "psych.h"
+#include "psych_batch.h"
+
+// Columns of a result row
+#define DEGDAY_CDD 0		// cooling degree-days [degC day]
+#define DEGDAY_HDD 1		// heating degree-days [degC day]
+#define DEGDAY_EH 2			// enthalpy-hours above the base enthalpy [kJ/kg h]
+#define DEGDAY_LATENT 3		// latent enthalpy-hours above the base humidity ratio [kJ/kg h]
+#define DEGDAY_HOURS 4		// hours with Tdb above the base temperature
+#define DEGDAY_NOUT 5
+
+#define DEGDAY_CHUNK 256	// hours converted to W and h per batch call
+
+
+typedef struct
+{
+	double Tb;		// base (balance point) temperature [degC]
+	double hb;		// base enthalpy [kJ/kg dry air]
+	double Wb;		// base humidity ratio [kg/kg dry air]
+} degday_base;
+
+
+void degday_base_point(degday_base *b, double Tb, double RHb, double P)
+/*
+ * Fills a base point from a base temperature [degC] and RH [Fraction]
+ * e.g. a 24 degC, 50% RH indoor condition at pressure P [kPa]
+ */
+{
+	b->Tb = Tb;
+	b->Wb = hum_rat2(Tb, RHb, P);
+	b->hb = enthalpy_air_h2o(Tb, b->Wb);
+}
+
+
+void degday_station(const double *Tdb, const double *RH, double P, int nh,
+		const degday_base *base, int nb, double *out)
+/*
+ * Computes every index for nb base points from nh hourly readings
+ * Tdb = hourly dry bulb temperatures [degC]
+ * RH = hourly relative humidities [Fraction]
+ * P = station pressure [kPa]
+ * out = nb * DEGDAY_NOUT results, row j for base[j]
+ * Hours with a missing Tdb (NaN) are skipped; a missing RH only leaves the
+ * hour out of the enthalpy-hours and latent enthalpy-hours.
+ */
+{
+	int i, j, k, m;
+	double W[DEGDAY_CHUNK], h[DEGDAY_CHUNK];
+
+	for(j = 0; j < nb * DEGDAY_NOUT; j++)
+	{
+		out[j] = 0;
+	}
+
+	for(i = 0; i < nh; i += DEGDAY_CHUNK)
+	{
+		m = nh - i < DEGDAY_CHUNK ? nh - i : DEGDAY_CHUNK;
+		hum_rat2_batch(Tdb + i, RH + i, P, W, m);
+		enthalpy_air_h2o_batch(Tdb + i, W, h, m);
+
+		for(k = 0; k < m; k++)
+		{
+			double T = Tdb[i + k];
+			int humid = isfinite(W[k]);		// false when only RH is missing
+			if(!isfinite(T))
+			{
+				continue;
+			}
+			for(j = 0; j < nb; j++)
+			{
+				double *row = out + j * DEGDAY_NOUT;
+				double dT = T - base[j].Tb;
+				double dh = h[k] - base[j].hb;
+				double dW = W[k] - base[j].Wb;
+				row[DEGDAY_CDD] += dT > 0 ? dT : 0;
+				row[DEGDAY_HDD] += dT < 0 ? -dT : 0;
+				row[DEGDAY_HOURS] += dT > 0;
+				if(humid)
+				{
+					row[DEGDAY_EH] += dh > 0 ? dh : 0;
+					row[DEGDAY_LATENT] += dW > 0 ? 2501 * dW : 0;
+				}
+			}
+		}
+	}
+
+	for(j = 0; j < nb; j++)
+	{
+		out[j * DEGDAY_NOUT + DEGDAY_CDD] /= 24;	// degree-hours to degree-days
+		out[j * DEGDAY_NOUT + DEGDAY_HDD] /= 24;
+	}
+}
+
+
+void degday_stations(const double *Tdb, const double *RH, const double *P, int ns, int nh,
+		const degday_base *base, int nb, double *out)
+/*
+ * Runs degday_station() for ns stations
+ * Tdb, RH = ns * nh hourly readings, station s starting at s * nh
+ * P = ns station pressures [kPa]
+ * out = ns * nb * DEGDAY_NOUT results, station s starting at s * nb * DEGDAY_NOUT
+ */
+{
+	int s;
+	#pragma omp parallel for schedule(dynamic, 4)
+	for(s = 0; s < ns; s++)
+	{
+		degday_station(Tdb + (size_t)s * nh, RH + (size_t)s * nh, P[s], nh,
+				base, nb, out + (size_t)s * nb * DEGDAY_NOUT);
+	}
+}
+
+
+#endif
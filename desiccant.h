@@ -0,0 +1,174 @@
+/*
+ * desiccant.h
+ *
+ * Desiccant wheel dehumidifier, empirical effectiveness model.
+ *
+ * An ideal wheel delivers process air on the process inlet enthalpy line
+ * at the relative humidity of the regeneration inlet air (the desiccant
+ * leaves the regeneration side in equilibrium with it).  A real wheel
+ * reaches a fraction eps_W of that humidity drop and carries over a
+ * fraction eps_h of the regeneration enthalpy excess.  The regeneration
+ * outlet follows from the moisture and energy balance.
+ *
+ */
+
+#ifndef DESICCANT_H
+#define DESICCANT_H
+#include <stddef.h>
+#include <math.h>
+#include "psych.h"
+
+#define DW_SOLVE_ITER 48	// bisection steps for the equilibrium state, ~1e-13 degC
+
+
+typedef struct
+{
+	double Tdb;		// dry bulb [degC]
+	double W;		// humidity ratio [kg/kg dry air]
+	double h;		// enthalpy [kJ/kg dry air]
+} dw_state;
+
+
+typedef struct
+{
+	double eps_W;		// moisture effectiveness, 0.6 to 0.9 typical
+	double eps_h;		// enthalpy carryover fraction, 0 to 0.1 typical
+	double ratio;		// regeneration to process dry air mass flow ratio
+	double Treg;		// regeneration inlet temperature [degC]
+	double P;			// ambient pressure [kPa]
+	double Pws_reg;		// cached sat_press(Treg) [kPa]
+} dw_wheel;
+
+
+void dw_init(dw_wheel *w, double eps_W, double eps_h, double ratio, double Treg, double P)
+/*
+ * Sets up a wheel, caching the regeneration saturation pressure so an
+ * hourly run with a fixed regeneration setpoint evaluates it only once
+ */
+{
+	w->eps_W = eps_W;
+	w->eps_h = eps_h;
+	w->ratio = ratio;
+	w->Treg = Treg;
+	w->P = P;
+	w->Pws_reg = sat_press(Treg);
+}
+
+
+void dw_set_state(dw_state *s, double Tdb, double W)
+/*
+ * Fills a state from dry bulb [degC] and humidity ratio [kg/kg dry air]
+ */
+{
+	s->Tdb = Tdb;
+	s->W = W;
+	s->h = enthalpy_air_h2o(Tdb, W);
+}
+
+
+double dw_tdb_from_hw(double h, double W)
+/*
+ * Dry bulb [degC] from enthalpy [kJ/kg] and humidity ratio, inverse of
+ * enthalpy_air_h2o()
+ */
+{
+	return (h - 2501 * W) / (1.006 + 1.86 * W);
+}
+
+
+double dw_equilibrium_w(double h, double RH, double P, double Tlo)
+/*
+ * Humidity ratio where the constant enthalpy line h [kJ/kg] crosses the
+ * relative humidity RH [Fraction], searching dry bulbs above Tlo [degC]
+ * RH falls monotonically along the line as the air warms and dries, so
+ * a fixed count bisection gives a bounded cost for every hour.
+ */
+{
+	int i;
+	double lo = Tlo, hi = h / 1.006;	// hi is the bone dry end of the line
+	double T, W;
+
+	for(i = 0; i < DW_SOLVE_ITER; i++)
+	{
+		T = (lo + hi) / 2;
+		W = (h - 1.006 * T) / (2501 + 1.86 * T);
+		if(rel_hum2(T, W, P) > RH)
+		{
+			lo = T;
+		}
+		else
+		{
+			hi = T;
+		}
+	}
+	T = (lo + hi) / 2;
+	return (h - 1.006 * T) / (2501 + 1.86 * T);
+}
+
+
+void dw_run(const dw_wheel *w, const dw_state *proc, double Wreg, dw_state *proc_out, dw_state *reg_out)
+/*
+ * Computes the process and regeneration outlet states
+ * proc = process inlet
+ * Wreg = regeneration inlet humidity ratio [kg/kg], at w->Treg
+ * reg_out may be NULL when only the process side is needed
+ */
+{
+	double RHreg = part_press(w->P, Wreg) / w->Pws_reg;	// rel_hum2() with the cached Pws
+	double href = enthalpy_air_h2o(w->Treg, Wreg);
+	double Weq, Wout, hout;
+
+	if(rel_hum2(proc->Tdb, proc->W, w->P) > RHreg)
+	{
+		Weq = dw_equilibrium_w(proc->h, RHreg, w->P, proc->Tdb);
+	}
+	else
+	{
+		Weq = proc->W;	// regeneration air is no drier, nothing is removed
+	}
+	Wout = proc->W - w->eps_W * (proc->W - Weq);
+	hout = proc->h + w->eps_h * (href - proc->h);
+
+	proc_out->W = Wout;
+	proc_out->h = hout;
+	proc_out->Tdb = dw_tdb_from_hw(hout, Wout);
+
+	if(reg_out)
+	{
+		reg_out->W = Wreg + (proc->W - Wout) / w->ratio;
+		reg_out->h = href - (hout - proc->h) / w->ratio;
+		reg_out->Tdb = dw_tdb_from_hw(reg_out->h, reg_out->W);
+	}
+}
+
+
+void dw_hourly(const dw_wheel *w, const double *Tdb, const double *RH, int n,
+		double *Tout, double *Wout, double *removed)
+/*
+ * Runs the wheel over n hours of outdoor air used for both the process
+ * inlet and (heated to Treg) the regeneration inlet
+ * Tdb = outdoor dry bulb [degC]
+ * RH = outdoor relative humidity [Fraction]
+ * Tout, Wout = process outlet dry bulb [degC] and humidity ratio [kg/kg]
+ * removed = moisture removed per kg of process dry air [kg/kg]; may be NULL
+ */
+{
+	int i;
+	dw_state in, out;
+
+	for(i = 0; i < n; i++)
+	{
+		double W = hum_rat2(Tdb[i], RH[i], w->P);
+		dw_set_state(&in, Tdb[i], W);
+		dw_run(w, &in, W, &out, NULL);
+		Tout[i] = out.Tdb;
+		Wout[i] = out.W;
+		if(removed)
+		{
+			removed[i] = W - out.W;
+		}
+	}
+}
+
+
+#endif
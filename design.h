@@ -0,0 +1,106 @@
+/*
+ * design.h
+ *
+ * Design condition percentiles from hourly weather.
+ *
+ * Hourly dry bulb and RH are converted to humidity ratio, enthalpy and dew
+ * point with the batch kernels, and each property is fed to a t-digest.
+ * A design_stats is fixed size, so decades of hours per station run in
+ * bounded memory, and per-worker stats merge with design_merge().
+ *
+ */
+
+#ifndef DESIGN_H
+#define DESIGN_H
+#include "psych.h"
+#include "psych_batch.h"
+#include "tdigest.h"
+
+#define DESIGN_CHUNK 256	// hours converted per batch call
+
+
+typedef struct
+{
+	tdigest Tdb;	// dry bulb [degC]
+	tdigest Tdp;	// dew point [degC]
+	tdigest W;		// humidity ratio [kg/kg dry air]
+	tdigest h;		// enthalpy [kJ/kg dry air]
+} design_stats;
+
+
+void design_init(design_stats *d)
+/*
+ * Empties the accumulators
+ */
+{
+	tdigest_init(&d->Tdb);
+	tdigest_init(&d->Tdp);
+	tdigest_init(&d->W);
+	tdigest_init(&d->h);
+}
+
+
+void design_add_hours(design_stats *d, const double *Tdb, const double *RH, double P, int n)
+/*
+ * Adds n hourly readings
+ * Tdb = dry bulb temperatures [degC]
+ * RH = relative humidities [Fraction]
+ * P = station pressure [kPa]
+ * Missing hours (NaN) are skipped.
+ */
+{
+	int i, k, m;
+	double W[DESIGN_CHUNK], h[DESIGN_CHUNK];
+
+	for(i = 0; i < n; i += DESIGN_CHUNK)
+	{
+		m = n - i < DESIGN_CHUNK ? n - i : DESIGN_CHUNK;
+		hum_rat2_batch(Tdb + i, RH + i, P, W, m);
+		enthalpy_air_h2o_batch(Tdb + i, W, h, m);
+		for(k = 0; k < m; k++)
+		{
+			if(!isfinite(Tdb[i + k]) || !isfinite(W[k]) || W[k] <= 0)
+			{
+				continue;
+			}
+			tdigest_add(&d->Tdb, Tdb[i + k]);
+			tdigest_add(&d->W, W[k]);
+			tdigest_add(&d->h, h[k]);
+			tdigest_add(&d->Tdp, dew_point(P, W[k]));
+		}
+	}
+}
+
+
+void design_merge(design_stats *d, design_stats *other)
+/*
+ * Combines the hours of another worker or station into d
+ */
+{
+	tdigest_merge(&d->Tdb, &other->Tdb);
+	tdigest_merge(&d->Tdp, &other->Tdp);
+	tdigest_merge(&d->W, &other->W);
+	tdigest_merge(&d->h, &other->h);
+}
+
+
+double design_cooling(tdigest *t, double pct)
+/*
+ * Cooling design value exceeded pct percent of hours (0.4, 1 or 2)
+ * e.g. design_cooling(&d.Tdp, 0.4) is the 0.4% design dew point
+ */
+{
+	return tdigest_quantile(t, 1 - pct / 100);
+}
+
+
+double design_heating(tdigest *t, double pct)
+/*
+ * Heating design value, pct percent of hours are colder (99.6% = 0.4)
+ */
+{
+	return tdigest_quantile(t, pct / 100);
+}
+
+
+#endif
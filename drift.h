@@ -0,0 +1,178 @@
+/*
+ * drift.h
+ *
+ * Redundant sensor drift detection by psychrometric consistency.
+ *
+ * Air handlers often carry two humidity sensors that measure the same air
+ * (RH and dew point, or RH and wet bulb).  Each reading is converted to a
+ * common property (dew point [degC]) with the psych.h functions and the
+ * residual between the two is tracked with an EWMA and a two-sided CUSUM.
+ * A state is a few doubles, so one drift_state per sensor pair is enough
+ * to watch a whole fleet of live streams.
+ *
+ */
+
+#ifndef DRIFT_H
+#define DRIFT_H
+#include <math.h>
+#include "psych.h"
+
+
+typedef struct
+{
+	double lambda;		// EWMA weight of the newest residual (0 to 1)
+	double k;			// CUSUM slack, half the shift worth detecting [degC]
+	double h;			// CUSUM decision threshold [degC]
+	long warmup;		// samples used to learn the baseline offset
+
+	double base;		// baseline residual learned during warmup [degC]
+	double mean;		// EWMA of the residual [degC]
+	double var;			// EWMA of the squared deviation [degC^2]
+	double cusum_hi;	// upper CUSUM statistic [degC]
+	double cusum_lo;	// lower CUSUM statistic [degC]
+	long n;				// number of finite residuals seen
+	int flag;			// 0 ok, +1 drifting high, -1 drifting low
+} drift_state;
+
+
+void drift_init(drift_state *s, double lambda, double k, double h, long warmup)
+/*
+ * Resets a drift detector
+ * lambda = EWMA weight, 0.01 to 0.1 is typical for one minute trends
+ * k = CUSUM slack [degC], e.g. 0.25 to watch for a 0.5 degC shift
+ * h = CUSUM threshold [degC], larger values mean fewer false alarms
+ * warmup = number of samples averaged into the baseline before flagging
+ */
+{
+	s->lambda = lambda;
+	s->k = k;
+	s->h = h;
+	s->warmup = warmup;
+	s->base = 0;
+	s->mean = 0;
+	s->var = 0;
+	s->cusum_hi = 0;
+	s->cusum_lo = 0;
+	s->n = 0;
+	s->flag = 0;
+}
+
+
+double drift_dew_from_rh(double Tdb, double RH, double P)
+/*
+ * Dew point [degC] reported by an RH sensor
+ * Tdb = Dry bulb temperature [degC]
+ * RH = Relative humidity [Fraction]
+ * P = Ambient pressure [kPa]
+ */
+{
+	return dew_point(P, hum_rat2(Tdb, RH, P));
+}
+
+
+double drift_dew_from_wb(double Tdb, double Twb, double P)
+/*
+ * Dew point [degC] reported by a wet bulb sensor
+ * Tdb = Dry bulb temperature [degC]
+ * Twb = Wet bulb temperature [degC]
+ * P = Ambient pressure [kPa]
+ */
+{
+	return dew_point(P, hum_rat(Tdb, Twb, P));
+}
+
+
+int drift_update(drift_state *s, double residual)
+/*
+ * Adds one residual (sensor A minus sensor B, [degC]) to the detector
+ * Returns the drift flag: 0 ok, +1 sensor A reading high, -1 reading low
+ * Non-finite residuals (sensor dropout, RH of zero) are ignored.
+ * Once raised the flag stays set until drift_init() is called again.
+ */
+{
+	double d;
+
+	if(!isfinite(residual))
+	{
+		return s->flag;
+	}
+
+	s->n++;
+	if(s->n <= s->warmup)
+	{
+		// Running mean of the offset the two sensors agree on when healthy
+		s->base += (residual - s->base) / s->n;
+		s->mean = s->base;
+		return s->flag;
+	}
+
+	d = residual - s->base;
+	s->mean += s->lambda * (residual - s->mean);
+	s->var = (1 - s->lambda) * (s->var + s->lambda * d * d);
+
+	// Page's two sided CUSUM on the deviation from the baseline
+	s->cusum_hi = fmax(0, s->cusum_hi + d - s->k);
+	s->cusum_lo = fmax(0, s->cusum_lo - d - s->k);
+
+	if(s->flag == 0)
+	{
+		if(s->cusum_hi > s->h)
+		{
+			s->flag = 1;
+		}
+		else if(s->cusum_lo > s->h)
+		{
+			s->flag = -1;
+		}
+	}
+	return s->flag;
+}
+
+
+int drift_rh_dew(drift_state *s, double Tdb, double RH, double Tdp, double P)
+/*
+ * Checks an RH sensor against a dew point sensor in the same air stream
+ * Tdb = Dry bulb temperature [degC]
+ * RH = Relative humidity from sensor A [Fraction]
+ * Tdp = Dew point from sensor B [degC]
+ * P = Ambient pressure [kPa]
+ */
+{
+	return drift_update(s, drift_dew_from_rh(Tdb, RH, P) - Tdp);
+}
+
+
+int drift_rh_wb(drift_state *s, double Tdb, double RH, double Twb, double P)
+/*
+ * Checks an RH sensor against a wet bulb sensor in the same air stream
+ * Tdb = Dry bulb temperature [degC]
+ * RH = Relative humidity from sensor A [Fraction]
+ * Twb = Wet bulb temperature from sensor B [degC]
+ * P = Ambient pressure [kPa]
+ */
+{
+	return drift_update(s, drift_dew_from_rh(Tdb, RH, P) - drift_dew_from_wb(Tdb, Twb, P));
+}
+
+
+void drift_scan_rh_dew(drift_state *s, const double *Tdb, const double *RH, const double *Tdp,
+		double P, int *flag, int n)
+/*
+ * Updates n RH / dew point pairs from one scan of the fleet
+ * s, Tdb, RH, Tdp and flag are arrays of length n, one entry per pair
+ * flag may be NULL when only the states are needed
+ */
+{
+	int i;
+	for(i = 0; i < n; i++)
+	{
+		int f = drift_rh_dew(&s[i], Tdb[i], RH[i], Tdp[i], P);
+		if(flag)
+		{
+			flag[i] = f;
+		}
+	}
+}
+
+
+#endif
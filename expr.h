@@ -0,0 +1,791 @@
+/*
+ * expr.h
+ *
+ * Vectorized expression language for user defined psych formulas.
+ *
+ * A formula such as "enthalpy_air_h2o(Toa, hum_rat2(Toa, RHoa, 101.325))
+ * - hra" is compiled once to a stack bytecode whose instructions operate
+ * on EXPR_CHUNK rows at a time.  Each instruction is a straight loop or a
+ * psych_batch.h kernel call, so the cost of decoding an instruction is
+ * spread over a whole chunk instead of paid per row.  Constant parts are
+ * folded at compile time, and a constant pressure argument selects the
+ * batch kernel that takes P as a scalar.
+ *
+ * Grammar (usual precedence, ^ binds tightest and is right associative):
+ *   expr    = term { ("+" | "-") term }
+ *   term    = unary { ("*" | "/") unary }
+ *   unary   = "-" unary | power
+ *   power   = primary [ "^" unary ]
+ *   primary = number | column | function "(" expr { "," expr } ")" | "(" expr ")"
+ * Functions: the psych.h functions sat_press(Tdb), part_press(P, W),
+ * hum_rat(Tdb, Twb, P), hum_rat2(Tdb, RH, P), rel_hum2(Tdb, W, P),
+ * enthalpy_air_h2o(Tdb, W), dew_point(P, W), dry_air_density(P, Tdb, W)
+ * and min, max, abs, sqrt, exp, log.
+ *
+ */
+
+#ifndef EXPR_H
+#define EXPR_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "psych.h"
+#include "psych_batch.h"
+#include "metrics.h"
+
+#define EXPR_CHUNK 256		// rows per instruction
+#define EXPR_STACK 16		// deepest value stack of a formula
+#define EXPR_MAXCODE 256	// instructions of a formula
+#define EXPR_MAXNODE 256	// parse tree nodes of a formula
+#define EXPR_MAXCOLS 64		// columns a formula can name
+#define EXPR_MAXDEPTH 64	// nesting of parentheses, signs, powers and calls
+
+// Instructions; a K suffix takes its constant operand from the instruction
+#define EX_VAR 0			// push column arg
+#define EX_CONST 1			// push k
+#define EX_NEG 2
+#define EX_ADD 3
+#define EX_SUB 4
+#define EX_MUL 5
+#define EX_DIV 6
+#define EX_POW 7
+#define EX_ADDK 8			// a + k
+#define EX_SUBK 9			// a - k
+#define EX_RSUBK 10			// k - a
+#define EX_MULK 11			// a * k
+#define EX_DIVK 12			// a / k
+#define EX_RDIVK 13			// k / a
+#define EX_POWK 14			// a ^ k
+#define EX_MIN 15
+#define EX_MAX 16
+#define EX_ABS 17
+#define EX_SQRT 18
+#define EX_EXP 19
+#define EX_LOG 20
+#define EX_SAT_PRESS 21
+#define EX_PART_PRESS 22
+#define EX_HUM_RAT 23
+#define EX_HUM_RAT2 24
+#define EX_REL_HUM2 25
+#define EX_ENTHALPY 26
+#define EX_DEW_POINT 27
+#define EX_DENSITY 28
+#define EX_PART_PRESS_K 29	// P = k
+#define EX_HUM_RAT2_K 30
+#define EX_REL_HUM2_K 31
+#define EX_DEW_POINT_K 32
+#define EX_DENSITY_K 33
+
+
+typedef struct
+{
+	int op;
+	int arg;		// column of EX_VAR
+	double k;		// constant operand
+} expr_ins;
+
+
+typedef struct
+{
+	int n;							// instructions
+	expr_ins code[EXPR_MAXCODE];
+	int depth;						// deepest stack reached
+	char err[80];					// message when compiling failed
+	int errpos;						// offset in the source of the error
+} expr_prog;
+
+
+typedef struct
+{
+	const char *name;
+	int nargs;
+	int op;
+	int kop;		// variant with a constant pressure, 0 if none
+	int pidx;		// argument that is the pressure
+} expr_func;
+
+
+const expr_func expr_funcs[] =
+{
+	{"sat_press", 1, EX_SAT_PRESS, 0, 0},
+	{"part_press", 2, EX_PART_PRESS, EX_PART_PRESS_K, 0},
+	{"hum_rat", 3, EX_HUM_RAT, 0, 0},
+	{"hum_rat2", 3, EX_HUM_RAT2, EX_HUM_RAT2_K, 2},
+	{"rel_hum2", 3, EX_REL_HUM2, EX_REL_HUM2_K, 2},
+	{"enthalpy_air_h2o", 2, EX_ENTHALPY, 0, 0},
+	{"dew_point", 2, EX_DEW_POINT, EX_DEW_POINT_K, 0},
+	{"dry_air_density", 3, EX_DENSITY, EX_DENSITY_K, 0},
+	{"min", 2, EX_MIN, 0, 0},
+	{"max", 2, EX_MAX, 0, 0},
+	{"abs", 1, EX_ABS, 0, 0},
+	{"sqrt", 1, EX_SQRT, 0, 0},
+	{"exp", 1, EX_EXP, 0, 0},
+	{"log", 1, EX_LOG, 0, 0},
+	{NULL, 0, 0, 0, 0}
+};
+
+
+double expr_apply(int op, double a, double b, double c)
+/*
+ * One row of an instruction without a constant operand
+ * Used to fold constants and for the rows of the general psych instructions.
+ */
+{
+	switch(op)
+	{
+	case EX_NEG: return -a;
+	case EX_ADD: return a + b;
+	case EX_SUB: return a - b;
+	case EX_MUL: return a * b;
+	case EX_DIV: return a / b;
+	case EX_POW: return pow(a, b);
+	case EX_MIN: return fmin(a, b);
+	case EX_MAX: return fmax(a, b);
+	case EX_ABS: return fabs(a);
+	case EX_SQRT: return sqrt(a);
+	case EX_EXP: return exp(a);
+	case EX_LOG: return log(a);
+	case EX_SAT_PRESS: return sat_press(a);
+	case EX_PART_PRESS: return part_press(a, b);
+	case EX_HUM_RAT: return hum_rat(a, b, c);
+	case EX_HUM_RAT2: return hum_rat2(a, b, c);
+	case EX_REL_HUM2: return rel_hum2(a, b, c);
+	case EX_ENTHALPY: return enthalpy_air_h2o(a, b);
+	case EX_DEW_POINT: return dew_point(a, b);
+	case EX_DENSITY: return dry_air_density(a, b, c);
+	}
+	return NAN;
+}
+
+
+int expr_nin(int op)
+/*
+ * Stack values an instruction consumes
+ */
+{
+	switch(op)
+	{
+	case EX_VAR: case EX_CONST:
+		return 0;
+	case EX_ADD: case EX_SUB: case EX_MUL: case EX_DIV: case EX_POW: case EX_MIN: case EX_MAX:
+	case EX_PART_PRESS: case EX_ENTHALPY: case EX_DEW_POINT:
+	case EX_HUM_RAT2_K: case EX_REL_HUM2_K: case EX_DENSITY_K:
+		return 2;
+	case EX_HUM_RAT: case EX_HUM_RAT2: case EX_REL_HUM2: case EX_DENSITY:
+		return 3;
+	}
+	return 1;
+}
+
+
+/*
+ * Compiler
+ */
+
+typedef struct
+{
+	int op;			// EX_CONST, EX_VAR or the operation
+	int n;			// arguments
+	int a[3];		// argument nodes
+	int arg;		// column of EX_VAR
+	double k;		// value of EX_CONST
+} expr_node;
+
+
+typedef struct
+{
+	const char *src;
+	const char *s;
+	const char *const *cols;
+	int ncols;
+	expr_node node[EXPR_MAXNODE];
+	int nn;
+	int depth;		// expr_unary() calls in progress
+	expr_prog *p;
+} expr_parser;
+
+
+int expr_fail(expr_parser *ps, const char *msg)
+/*
+ * Records the first error and its position, returns -1
+ */
+{
+	if(!ps->p->err[0])
+	{
+		snprintf(ps->p->err, sizeof(ps->p->err), "%s", msg);
+		ps->p->errpos = (int)(ps->s - ps->src);
+	}
+	return -1;
+}
+
+
+int expr_mknode(expr_parser *ps, int op, int n, int a, int b, int c)
+/*
+ * Adds a parse tree node, folding it to a constant when all its
+ * arguments are constants
+ */
+{
+	expr_node *e;
+	int k, konst = n > 0;
+
+	if(ps->nn == EXPR_MAXNODE)
+	{
+		return expr_fail(ps, "formula too long");
+	}
+	e = &ps->node[ps->nn];
+	e->op = op;
+	e->n = n;
+	e->a[0] = a;
+	e->a[1] = b;
+	e->a[2] = c;
+	for(k = 0; k < n; k++)
+	{
+		konst = konst && ps->node[e->a[k]].op == EX_CONST;
+	}
+	if(konst)
+	{
+		e->k = expr_apply(op, ps->node[a].k, n > 1 ? ps->node[b].k : 0, n > 2 ? ps->node[c].k : 0);
+		e->op = EX_CONST;
+		e->n = 0;
+	}
+	return ps->nn++;
+}
+
+
+void expr_space(expr_parser *ps)
+/*
+ * Skips white space
+ */
+{
+	while(isspace((unsigned char)*ps->s))
+	{
+		ps->s++;
+	}
+}
+
+
+int expr_accept(expr_parser *ps, char c)
+/*
+ * Consumes c if it is the next character, returns non zero if it was
+ */
+{
+	expr_space(ps);
+	if(*ps->s == c)
+	{
+		ps->s++;
+		return 1;
+	}
+	return 0;
+}
+
+
+int expr_parse(expr_parser *ps);
+
+
+int expr_primary(expr_parser *ps)
+/*
+ * The parse functions below return the index of the node they built, or
+ * -1 after expr_fail()
+ */
+{
+	char name[64];
+	int n = 0, k, e;
+	int a[3];
+
+	expr_space(ps);
+	if(isdigit((unsigned char)*ps->s) || *ps->s == '.')
+	{
+		char *end;
+		double v = strtod(ps->s, &end);
+		if(end == ps->s)
+		{
+			return expr_fail(ps, "bad number");
+		}
+		ps->s = end;
+		e = expr_mknode(ps, EX_CONST, 0, -1, -1, -1);
+		if(e >= 0)
+		{
+			ps->node[e].k = v;
+		}
+		return e;
+	}
+	if(expr_accept(ps, '('))
+	{
+		e = expr_parse(ps);
+		if(e >= 0 && !expr_accept(ps, ')'))
+		{
+			return expr_fail(ps, "expected )");
+		}
+		return e;
+	}
+	if(!isalpha((unsigned char)*ps->s) && *ps->s != '_')
+	{
+		return expr_fail(ps, "expected a number, column or function");
+	}
+
+	while((isalnum((unsigned char)*ps->s) || *ps->s == '_') && n < 63)
+	{
+		name[n++] = *ps->s++;
+	}
+	name[n] = 0;
+
+	if(!expr_accept(ps, '('))
+	{
+		for(k = 0; k < ps->ncols; k++)
+		{
+			if(strcmp(ps->cols[k], name) == 0)
+			{
+				e = expr_mknode(ps, EX_VAR, 0, -1, -1, -1);
+				if(e >= 0)
+				{
+					ps->node[e].arg = k;
+				}
+				return e;
+			}
+		}
+		return expr_fail(ps, "unknown column");
+	}
+
+	for(k = 0; expr_funcs[k].name; k++)
+	{
+		if(strcmp(expr_funcs[k].name, name) == 0)
+		{
+			break;
+		}
+	}
+	if(!expr_funcs[k].name)
+	{
+		return expr_fail(ps, "unknown function");
+	}
+	for(n = 0; n < expr_funcs[k].nargs; n++)
+	{
+		if(n > 0 && !expr_accept(ps, ','))
+		{
+			return expr_fail(ps, "too few arguments");
+		}
+		if((a[n] = expr_parse(ps)) < 0)
+		{
+			return -1;
+		}
+	}
+	if(!expr_accept(ps, ')'))
+	{
+		return expr_fail(ps, "expected )");
+	}
+	return expr_mknode(ps, expr_funcs[k].op, n, a[0], n > 1 ? a[1] : -1, n > 2 ? a[2] : -1);
+}
+
+
+int expr_unary(expr_parser *ps)
+/*
+ * Every recursion of the parser passes through here, so the depth limit
+ * here bounds the C stack; '(' and a leading '-' build no node, and the
+ * node limit alone would not
+ */
+{
+	int a, b;
+	if(ps->depth == EXPR_MAXDEPTH)
+	{
+		return expr_fail(ps, "formula nested too deeply");
+	}
+	ps->depth++;
+	if(expr_accept(ps, '-'))
+	{
+		a = expr_unary(ps);
+		a = a < 0 ? -1 : expr_mknode(ps, EX_NEG, 1, a, -1, -1);
+	}
+	else
+	{
+		a = expr_primary(ps);
+		if(a >= 0 && expr_accept(ps, '^'))
+		{
+			b = expr_unary(ps);
+			a = b < 0 ? -1 : expr_mknode(ps, EX_POW, 2, a, b, -1);
+		}
+	}
+	ps->depth--;
+	return a;
+}
+
+
+int expr_term(expr_parser *ps)
+{
+	int a = expr_unary(ps), b, op;
+	while(a >= 0)
+	{
+		if(expr_accept(ps, '*'))
+		{
+			op = EX_MUL;
+		}
+		else if(expr_accept(ps, '/'))
+		{
+			op = EX_DIV;
+		}
+		else
+		{
+			break;
+		}
+		b = expr_unary(ps);
+		a = b < 0 ? -1 : expr_mknode(ps, op, 2, a, b, -1);
+	}
+	return a;
+}
+
+
+int expr_parse(expr_parser *ps)
+{
+	int a = expr_term(ps), b, op;
+	while(a >= 0)
+	{
+		if(expr_accept(ps, '+'))
+		{
+			op = EX_ADD;
+		}
+		else if(expr_accept(ps, '-'))
+		{
+			op = EX_SUB;
+		}
+		else
+		{
+			break;
+		}
+		b = expr_term(ps);
+		a = b < 0 ? -1 : expr_mknode(ps, op, 2, a, b, -1);
+	}
+	return a;
+}
+
+
+int expr_emit(expr_parser *ps, int op, int arg, double k, int *sp)
+/*
+ * Appends an instruction, tracking the stack depth sp
+ */
+{
+	expr_prog *p = ps->p;
+	if(p->n == EXPR_MAXCODE)
+	{
+		return expr_fail(ps, "formula too long");
+	}
+	*sp += 1 - expr_nin(op);
+	if(*sp > EXPR_STACK)
+	{
+		return expr_fail(ps, "formula nested too deeply");
+	}
+	if(*sp > p->depth)
+	{
+		p->depth = *sp;
+	}
+	p->code[p->n].op = op;
+	p->code[p->n].arg = arg;
+	p->code[p->n].k = k;
+	p->n++;
+	return 0;
+}
+
+
+int expr_gen(expr_parser *ps, int i, int *sp)
+/*
+ * Emits the code of node i, using the K instructions where an operand is
+ * a constant
+ */
+{
+	const expr_node *e = &ps->node[i];
+	const expr_node *a = e->n > 0 ? &ps->node[e->a[0]] : NULL;
+	const expr_node *b = e->n > 1 ? &ps->node[e->a[1]] : NULL;
+	int k;
+
+	if(e->op == EX_CONST || e->op == EX_VAR)
+	{
+		return expr_emit(ps, e->op, e->arg, e->k, sp);
+	}
+
+	// Arithmetic with one constant operand
+	if(e->n == 2 && (b->op == EX_CONST || a->op == EX_CONST))
+	{
+		int bk = b->op == EX_CONST;
+		int kop = 0;
+		switch(e->op)
+		{
+		case EX_ADD: kop = EX_ADDK; break;
+		case EX_MUL: kop = EX_MULK; break;
+		case EX_SUB: kop = bk ? EX_SUBK : EX_RSUBK; break;
+		case EX_DIV: kop = bk ? EX_DIVK : EX_RDIVK; break;
+		case EX_POW: kop = bk ? EX_POWK : 0; break;
+		}
+		if(kop)
+		{
+			if(expr_gen(ps, bk ? e->a[0] : e->a[1], sp) < 0)
+			{
+				return -1;
+			}
+			return expr_emit(ps, kop, 0, bk ? b->k : a->k, sp);
+		}
+	}
+
+	// Psych functions with a constant pressure
+	for(k = 0; expr_funcs[k].name; k++)
+	{
+		const expr_func *f = &expr_funcs[k];
+		if(f->op == e->op && f->kop && ps->node[e->a[f->pidx]].op == EX_CONST)
+		{
+			int j;
+			for(j = 0; j < e->n; j++)
+			{
+				if(j != f->pidx && expr_gen(ps, e->a[j], sp) < 0)
+				{
+					return -1;
+				}
+			}
+			return expr_emit(ps, f->kop, 0, ps->node[e->a[f->pidx]].k, sp);
+		}
+	}
+
+	for(k = 0; k < e->n; k++)
+	{
+		if(expr_gen(ps, e->a[k], sp) < 0)
+		{
+			return -1;
+		}
+	}
+	return expr_emit(ps, e->op, 0, 0, sp);
+}
+
+
+int expr_compile(expr_prog *p, const char *src, const char *const *cols, int ncols)
+/*
+ * Compiles a formula over the named columns; column k of the rows passed
+ * to expr_run() is cols[k]
+ * Returns 0 on success, -1 with p->err and p->errpos set on a syntax error
+ * or a formula too large for the fixed limits
+ */
+{
+	expr_parser *ps = malloc(sizeof(expr_parser));
+	int root, sp = 0;
+
+	memset(p, 0, sizeof(*p));
+	if(!ps)
+	{
+		snprintf(p->err, sizeof(p->err), "out of memory");
+		return -1;
+	}
+	ps->src = src;
+	ps->s = src;
+	ps->cols = cols;
+	ps->ncols = ncols < EXPR_MAXCOLS ? ncols : EXPR_MAXCOLS;
+	ps->nn = 0;
+	ps->depth = 0;
+	ps->p = p;
+
+	root = expr_parse(ps);
+	expr_space(ps);
+	if(root >= 0 && *ps->s)
+	{
+		root = expr_fail(ps, "unexpected character");
+	}
+	if(root >= 0)
+	{
+		root = expr_gen(ps, root, &sp);
+	}
+	free(ps);
+	return root < 0 ? -1 : 0;
+}
+
+
+/*
+ * Interpreter
+ */
+
+void expr_chunk(const expr_prog *p, const double *const *cols, long i0, int m, double *out)
+/*
+ * Runs a program over rows i0 to i0 + m - 1, m <= EXPR_CHUNK
+ * Stack slot j points either straight into a column or to buffer st[j].
+ * An instruction writes to the spare buffer, which then trades places
+ * with the buffer of its result slot, so no kernel reads and writes the
+ * same array.
+ */
+{
+	double mem[EXPR_STACK + 2][EXPR_CHUNK];
+	double *st[EXPR_STACK + 1];
+	double *tmp = mem[EXPR_STACK + 1];
+	const double *v[EXPR_STACK];
+	int j, pc, sp = 0;
+
+	for(j = 0; j <= EXPR_STACK; j++)
+	{
+		st[j] = mem[j];
+	}
+
+	for(pc = 0; pc < p->n; pc++)
+	{
+		const expr_ins *in = &p->code[pc];
+		double *r = st[EXPR_STACK];
+		const double *a, *b, *c;
+		double k = in->k;
+		int i, nin;
+
+		if(in->op == EX_VAR)
+		{
+			v[sp++] = cols[in->arg] + i0;
+			continue;
+		}
+		if(in->op == EX_CONST)
+		{
+			for(i = 0; i < m; i++)
+			{
+				st[sp][i] = k;
+			}
+			v[sp] = st[sp];
+			sp++;
+			continue;
+		}
+
+		nin = expr_nin(in->op);
+		a = v[sp - nin];
+		b = nin > 1 ? v[sp - nin + 1] : NULL;
+		c = nin > 2 ? v[sp - nin + 2] : NULL;
+
+		switch(in->op)
+		{
+		case EX_NEG:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = -a[i];
+			break;
+		case EX_ADD:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = a[i] + b[i];
+			break;
+		case EX_SUB:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = a[i] - b[i];
+			break;
+		case EX_MUL:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = a[i] * b[i];
+			break;
+		case EX_DIV:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = a[i] / b[i];
+			break;
+		case EX_ADDK:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = a[i] + k;
+			break;
+		case EX_SUBK:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = a[i] - k;
+			break;
+		case EX_RSUBK:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = k - a[i];
+			break;
+		case EX_MULK:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = a[i] * k;
+			break;
+		case EX_DIVK:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = a[i] / k;
+			break;
+		case EX_RDIVK:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = k / a[i];
+			break;
+		case EX_POWK:
+			if(k == 2)
+			{
+				#pragma omp simd
+				for(i = 0; i < m; i++) r[i] = a[i] * a[i];
+			}
+			else
+			{
+				#pragma omp simd
+				for(i = 0; i < m; i++) r[i] = pow(a[i], k);
+			}
+			break;
+		case EX_MIN:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = fmin(a[i], b[i]);
+			break;
+		case EX_MAX:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = fmax(a[i], b[i]);
+			break;
+		case EX_ABS:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = fabs(a[i]);
+			break;
+		case EX_SQRT:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = sqrt(a[i]);
+			break;
+		case EX_EXP:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = exp(a[i]);
+			break;
+		case EX_LOG:
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] = log(a[i]);
+			break;
+		case EX_SAT_PRESS:
+			sat_press_batch(a, r, m);
+			break;
+		case EX_ENTHALPY:
+			enthalpy_air_h2o_batch(a, b, r, m);
+			break;
+		case EX_PART_PRESS_K:
+			part_press_batch(k, a, r, m);
+			break;
+		case EX_HUM_RAT2_K:
+			hum_rat2_batch(a, b, k, r, m);
+			break;
+		case EX_REL_HUM2_K:
+			part_press_batch(k, b, r, m);
+			sat_press_batch(a, tmp, m);
+			#pragma omp simd
+			for(i = 0; i < m; i++) r[i] /= tmp[i];
+			break;
+		case EX_DEW_POINT_K:
+			dew_point_batch(k, a, r, m);
+			break;
+		case EX_DENSITY_K:
+			dry_air_density_batch(k, a, b, r, m);
+			break;
+		default:
+			// Psych functions of a varying pressure, and pow of two columns
+			for(i = 0; i < m; i++)
+			{
+				r[i] = expr_apply(in->op, a[i], b ? b[i] : 0, c ? c[i] : 0);
+			}
+		}
+
+		sp -= nin;
+		st[EXPR_STACK] = st[sp];
+		st[sp] = r;
+		v[sp++] = r;
+	}
+	memcpy(out + i0, v[0], sizeof(double) * m);
+}
+
+
+void expr_run(const expr_prog *p, const double *const *cols, long n, double *out)
+/*
+ * Evaluates a compiled formula over n rows
+ * cols = the columns named at compile time, each of n values
+ * out = n results
+ * Chunks run in parallel when built with -fopenmp.
+ */
+{
+	long c;
+	#pragma omp parallel for schedule(static)
+	for(c = 0; c < n; c += EXPR_CHUNK)
+	{
+		uint64_t t0 = metrics_clock();
+		expr_chunk(p, cols, c, n - c < EXPR_CHUNK ? (int)(n - c) : EXPR_CHUNK, out);
+		metric_observe(METRIC_LAT_EXPR_CHUNK, metrics_clock() - t0);
+	}
+}
+
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ ============================================================================
+ Name        : fuzz.c
+ Description : Fuzz harness for the psych solvers: flags non-termination,
+               NaN results and wet bulb solves over the iteration budget in
+               psych(), wet_bulb() and dw_equilibrium_w()
+ Build       : clang -g -O1 -fsanitize=fuzzer,address,undefined fuzz.c -o fuzz -lm
+               cc -g -O1 -fsanitize=address,undefined -DFUZZ_MAIN fuzz.c -o fuzz -lm
+ Usage       : fuzz [-n runs] [-s seed] [input...]   (the -DFUZZ_MAIN build)
+ ============================================================================
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned long wb_steps;			// wet bulb Newton steps so far
+#define PSYCH_WB_COUNT wb_steps
+#include "psych.h"
+#include "desiccant.h"
+
+#define FUZZ_BUDGET 20		// wet bulb Newton steps allowed for physical inputs
+#define FUZZ_TIMEOUT 2		// [s] a single input may take, FUZZ_MAIN build
+#define FUZZ_INPUT 36		// bytes used from an input: 4 selector bytes, 4 doubles
+
+/*
+ * Input layout
+ * byte 0: target (0 wet_bulb, 1 psych, 2 dw_equilibrium_w); bit 7 set
+ *         feeds raw doubles and type codes, otherwise the doubles are mapped
+ *         onto physical states (-40 to 60 C, 1 to 100% RH, 60 to 110 kPa)
+ * byte 1: SI / IP, input type and output type of psych()
+ * bytes 2, 3: raw type codes
+ * bytes 4 to 35: four doubles
+ * Physical inputs must give finite results within the budget; raw inputs
+ * must only terminate.
+ */
+
+static const int fuzz_in[5] = {1, 2, 3, 4, 7};
+static const int fuzz_out[9] = {1, 2, 3, 4, 5, 6, 7, 9, 10};
+
+typedef struct
+{
+	int iters;			// most wet bulb steps of one input
+	double ns;			// longest input [ns]
+	uint8_t input[FUZZ_INPUT];
+} fuzz_worst;
+
+static fuzz_worst worst[3];
+static const char *target_name[3] = {"wet_bulb", "psych", "dw_equilibrium_w"};
+static const uint8_t *volatile current;		// input being run, for the timeout report
+static volatile size_t current_size;
+static long runs, flagged;
+
+
+static double unit(const uint8_t *p)
+/*
+ * Maps 8 bytes onto [0, 1)
+ */
+{
+	uint64_t u;
+	memcpy(&u, p, 8);
+	return (u >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+static void hex(char *out, const uint8_t *data, size_t size)
+{
+	static const char digit[] = "0123456789abcdef";
+	size_t k;
+	for(k = 0; k < size; k++)
+	{
+		out[2 * k] = digit[data[k] >> 4];
+		out[2 * k + 1] = digit[data[k] & 15];
+	}
+	out[2 * size] = 0;
+}
+
+
+static void flag(const char *what, const uint8_t *data, size_t size, double a, double b, double c, double r)
+/*
+ * Reports a failing input; under libFuzzer it aborts so the input is saved
+ */
+{
+	char h[2 * FUZZ_INPUT + 1];
+	hex(h, data, size < FUZZ_INPUT ? size : FUZZ_INPUT);
+	fprintf(stderr, "%s: %s(%.17g, %.17g, %.17g) = %.17g, input %s\n", what, target_name[data[0] % 3], a, b, c, r, h);
+	flagged++;
+#ifndef FUZZ_MAIN
+	abort();
+#endif
+}
+
+
+static uint64_t fuzz_clock(void)
+/*
+ * Monotonic time [ns]
+ */
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	uint8_t in[FUZZ_INPUT] = {0};
+	double x[4], r = 0, a = 0, b = 0, c = 0;
+	int target, raw, k, iters, physical;
+	uint64_t s0, t0;
+
+	if(size == 0)
+	{
+		return 0;
+	}
+	memcpy(in, data, size < FUZZ_INPUT ? size : FUZZ_INPUT);
+	target = in[0] % 3;
+	raw = in[0] & 128;
+	physical = !raw;
+	for(k = 0; k < 4; k++)
+	{
+		memcpy(&x[k], in + 4 + 8 * k, 8);
+	}
+
+	s0 = wb_steps;
+	t0 = fuzz_clock();
+	if(raw)
+	{
+		a = x[0];
+		b = x[1];
+		c = x[2];
+		switch(target)
+		{
+		case 0: r = wet_bulb(a, b, c); break;
+		case 1: r = psych(c, a, b, (int8_t)in[2], (int8_t)in[3], in[1] & 1); break;
+		case 2: r = dw_equilibrium_w(a, b, c, x[3]); break;
+		}
+	}
+	else
+	{
+		double Tdb = -40 + 100 * unit(in + 4);
+		double RH = 0.01 + 0.99 * unit(in + 12);
+		double P = 60 + 50 * unit(in + 20);
+		double W = hum_rat2(Tdb, RH, P);
+		double h = enthalpy_air_h2o(Tdb, W);
+
+		switch(target)
+		{
+		case 0:
+			a = Tdb;
+			b = RH;
+			c = P;
+			r = wet_bulb(Tdb, RH, P);
+			break;
+		case 1:
+		{
+			int si = in[1] & 1, inType = fuzz_in[(in[1] >> 1) % 5], outType = fuzz_out[(in[1] >> 4) % 9];
+			double v = 0;
+			switch(inType)
+			{
+			case 1: v = wet_bulb(Tdb, RH, P); break;
+			case 2: v = dew_point(P, W); break;
+			case 3: v = RH; break;
+			case 4: v = W; break;
+			case 7: v = h; break;
+			}
+			s0 = wb_steps;		// only count the solves inside psych()
+			if(si)
+			{
+				a = 1000 * P;
+				b = Tdb;
+				c = v;
+			}
+			else
+			{
+				a = P / 6.894757293168361;
+				b = 1.8 * Tdb + 32;
+				c = inType <= 2 ? 1.8 * v + 32 : inType == 7 ? (v + 17.884444444) * 0.45359237 / 1.055056 : v;
+			}
+			r = psych(a, b, c, inType, outType, si);
+			break;
+		}
+		case 2:
+			// Regeneration air drier than the process air, as dw_run() calls it
+			a = h;
+			b = RH * unit(in + 28);
+			c = P;
+			r = dw_equilibrium_w(h, b, P, Tdb);
+			if(r < -1E-12 || r > W + 1E-12)
+			{
+				flag("out of range", data, size, a, b, c, r);
+			}
+			break;
+		}
+	}
+	t0 = fuzz_clock() - t0;
+	iters = (int)(wb_steps - s0);
+
+	runs++;
+	if(iters > worst[target].iters || (iters == worst[target].iters && t0 > worst[target].ns))
+	{
+		worst[target].iters = iters;
+		worst[target].ns = (double)t0;
+		memcpy(worst[target].input, in, FUZZ_INPUT);
+	}
+	if(iters > PSYCH_WB_MAXITER * 2)
+	{
+		flag("unbounded iterations", data, size, a, b, c, r);	// more than two bounded solves
+	}
+	else if(physical && !isfinite(r))
+	{
+		flag("not finite", data, size, a, b, c, r);
+	}
+	else if(physical && iters > FUZZ_BUDGET)
+	{
+		flag("over budget", data, size, a, b, c, r);
+	}
+	return 0;
+}
+
+
+static void summary(void)
+{
+	int t;
+	fprintf(stderr, "%ld inputs, %ld flagged\n", runs, flagged);
+	for(t = 0; t < 3; t++)
+	{
+		char h[2 * FUZZ_INPUT + 1];
+		hex(h, worst[t].input, FUZZ_INPUT);
+		fprintf(stderr, "worst %-16s %3d wet bulb steps %9.0f ns  input %s\n", target_name[t], worst[t].iters, worst[t].ns, h);
+	}
+}
+
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	(void)argc;
+	(void)argv;
+	atexit(summary);
+	return 0;
+}
+
+
+#ifdef FUZZ_MAIN
+
+static void on_alarm(int sig)
+/*
+ * An input ran past FUZZ_TIMEOUT: report it and quit, async signal safe
+ */
+{
+	char msg[64 + 2 * FUZZ_INPUT];
+	size_t n = current_size < FUZZ_INPUT ? current_size : FUZZ_INPUT;
+	ssize_t w;
+	(void)sig;
+	strcpy(msg, "timeout, input ");
+	hex(msg + strlen(msg), (const uint8_t *)current, n);
+	strcat(msg, "\n");
+	w = write(2, msg, strlen(msg));
+	(void)w;
+	_exit(2);
+}
+
+
+static int run(const uint8_t *data, size_t size)
+{
+	current = data;
+	current_size = size;
+	alarm(FUZZ_TIMEOUT);
+	LLVMFuzzerTestOneInput(data, size);
+	alarm(0);
+	return 0;
+}
+
+
+static int unhex(const char *s, uint8_t *out)
+/*
+ * Parses a hex input as printed in the reports, returns its length or -1
+ */
+{
+	int n = 0;
+	unsigned v;
+	while(n < FUZZ_INPUT && sscanf(s + 2 * n, "%2x", &v) == 1)
+	{
+		out[n++] = (uint8_t)v;
+	}
+	return n ? n : -1;
+}
+
+
+int main(int argc, char *argv[])
+/*
+ * Without libFuzzer: replays the inputs given (files, or hex strings as
+ * printed in the reports), or else runs random inputs
+ */
+{
+	uint64_t seed = 1;
+	long n = 1000000, i;
+	int opt, k;
+
+	while((opt = getopt(argc, argv, "n:s:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'n': n = atol(optarg); break;
+		case 's': seed = strtoull(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: fuzz [-n runs] [-s seed] [file or hex input...]\n");
+			return 2;
+		}
+	}
+	signal(SIGALRM, on_alarm);
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	if(optind < argc)
+	{
+		for(; optind < argc; optind++)
+		{
+			uint8_t buf[FUZZ_INPUT];
+			FILE *f = fopen(argv[optind], "rb");
+			int len;
+			if(f)
+			{
+				len = (int)fread(buf, 1, sizeof(buf), f);
+				fclose(f);
+			}
+			else
+			{
+				len = unhex(argv[optind], buf);
+			}
+			if(len > 0)
+			{
+				run(buf, len);
+			}
+		}
+		return flagged ? 1 : 0;
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		uint8_t buf[FUZZ_INPUT];
+		for(k = 0; k < FUZZ_INPUT; k += 8)
+		{
+			uint64_t r;
+			seed ^= seed >> 12;			// xorshift64*
+			seed ^= seed << 25;
+			seed ^= seed >> 27;
+			r = seed * 2685821657736338717ull;
+			memcpy(buf + k, &r, FUZZ_INPUT - k < 8 ? FUZZ_INPUT - k : 8);
+		}
+		run(buf, FUZZ_INPUT);
+	}
+	return flagged ? 1 : 0;
+}
+
+#endif
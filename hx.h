@@ -0,0 +1,185 @@
+/*
+ * hx.h
+ *
+ * Heat exchanger effectiveness-NTU engine.
+ *
+ * Effectiveness relations from Incropera, Fundamentals of Heat and Mass
+ * Transfer, table 11.3.  hx_eff_batch() evaluates one flow arrangement over
+ * arrays of NTU and capacity ratio; hx_air_water_batch() sizes the
+ * capacities from psych.h air properties and water.h fluid properties for
+ * coil and plate selection sweeps.  Only sensible (dry) heat transfer is
+ * modelled.
+ *
+ */
+
+#ifndef HX_H
+#define HX_H
+#include <math.h>
+#include "psych.h"
+#include "water.h"
+
+#define HX_COUNTER 1			// counterflow
+#define HX_PARALLEL 2			// parallel flow
+#define HX_CROSS_UNMIXED 3		// crossflow, both streams unmixed
+#define HX_CROSS_CMAX_MIXED 4	// crossflow, Cmax mixed, Cmin unmixed
+#define HX_CROSS_CMIN_MIXED 5	// crossflow, Cmin mixed, Cmax unmixed
+#define HX_SHELL_TUBE 6			// one shell pass, 2, 4, ... tube passes
+
+
+double cp_moist_air(double W)
+/*
+ * Specific heat of moist air [kJ/kg dry air K], consistent with enthalpy_air_h2o()
+ * W = humidity ratio [kg/kg dry air]
+ */
+{
+	return 1.006 + 1.86 * W;
+}
+
+
+double hx_eff(int type, double NTU, double Cr)
+/*
+ * Effectiveness of a heat exchanger
+ * type = HX_COUNTER, HX_PARALLEL, HX_CROSS_UNMIXED, HX_CROSS_CMAX_MIXED,
+ *        HX_CROSS_CMIN_MIXED or HX_SHELL_TUBE
+ * NTU = UA / Cmin
+ * Cr = Cmin / Cmax, 0 to 1
+ * Returns NaN for an unknown type
+ */
+{
+	double e, s;
+
+	if(Cr < 1E-9)
+	{
+		return 1 - exp(-NTU);	// condensing or evaporating stream, all types agree
+	}
+	switch(type)
+	{
+	case HX_COUNTER:
+		if(Cr > 1 - 1E-9)
+		{
+			return NTU / (1 + NTU);
+		}
+		e = exp(-NTU * (1 - Cr));
+		return (1 - e) / (1 - Cr * e);
+	case HX_PARALLEL:
+		return (1 - exp(-NTU * (1 + Cr))) / (1 + Cr);
+	case HX_CROSS_UNMIXED:
+		return 1 - exp(pow(NTU, 0.22) / Cr * (exp(-Cr * pow(NTU, 0.78)) - 1));
+	case HX_CROSS_CMAX_MIXED:
+		return (1 - exp(-Cr * (1 - exp(-NTU)))) / Cr;
+	case HX_CROSS_CMIN_MIXED:
+		return 1 - exp(-(1 - exp(-Cr * NTU)) / Cr);
+	case HX_SHELL_TUBE:
+		s = sqrt(1 + Cr * Cr);
+		e = exp(-NTU * s);
+		return 2 / (1 + Cr + s * (1 + e) / (1 - e));
+	}
+	return NAN;
+}
+
+
+void hx_eff_batch(int type, const double *NTU, const double *Cr, double *eff, int n)
+/*
+ * Effectiveness of n exchangers or operating points of one arrangement
+ * The type switch is outside the loop so each arrangement's loop is a
+ * straight line of exp / pow calls the compiler can vectorize.
+ */
+{
+	int i;
+	switch(type)
+	{
+	case HX_COUNTER:
+		#pragma omp simd
+		for(i = 0; i < n; i++)
+		{
+			double c = fmin(Cr[i], 1 - 1E-9);	// Cr = 1 limit is NTU / (1 + NTU)
+			double e = exp(-NTU[i] * (1 - c));
+			eff[i] = (1 - e) / (1 - c * e);
+		}
+		break;
+	case HX_PARALLEL:
+		#pragma omp simd
+		for(i = 0; i < n; i++)
+		{
+			eff[i] = (1 - exp(-NTU[i] * (1 + Cr[i]))) / (1 + Cr[i]);
+		}
+		break;
+	case HX_CROSS_UNMIXED:
+		#pragma omp simd
+		for(i = 0; i < n; i++)
+		{
+			double c = fmax(Cr[i], 1E-9);
+			eff[i] = 1 - exp(pow(NTU[i], 0.22) / c * (exp(-c * pow(NTU[i], 0.78)) - 1));
+		}
+		break;
+	case HX_CROSS_CMAX_MIXED:
+		#pragma omp simd
+		for(i = 0; i < n; i++)
+		{
+			double c = fmax(Cr[i], 1E-9);
+			eff[i] = (1 - exp(-c * (1 - exp(-NTU[i])))) / c;
+		}
+		break;
+	case HX_CROSS_CMIN_MIXED:
+		#pragma omp simd
+		for(i = 0; i < n; i++)
+		{
+			double c = fmax(Cr[i], 1E-9);
+			eff[i] = 1 - exp(-(1 - exp(-c * NTU[i])) / c);
+		}
+		break;
+	case HX_SHELL_TUBE:
+		#pragma omp simd
+		for(i = 0; i < n; i++)
+		{
+			double s = sqrt(1 + Cr[i] * Cr[i]);
+			double e = exp(-NTU[i] * s);
+			eff[i] = 2 / (1 + Cr[i] + s * (1 + e) / (1 - e));
+		}
+		break;
+	default:
+		for(i = 0; i < n; i++)
+		{
+			eff[i] = NAN;
+		}
+	}
+}
+
+
+void hx_air_water_batch(int type, const fluid_table *ft, double x, int n,
+		const double *m_air, const double *Tair, const double *W,
+		const double *m_w, const double *Tw, const double *UA,
+		double *Q, double *Tair_out, double *Tw_out)
+/*
+ * Sensible air to liquid exchange for n coils or operating points
+ * ft, x = liquid property table and glycol mass fraction
+ * m_air = dry air mass flows [kg/s]
+ * Tair, W = entering air dry bulb [degC] and humidity ratio [kg/kg]
+ * m_w = liquid mass flows [kg/s]
+ * Tw = entering liquid temperatures [degC]
+ * UA = overall conductances [kW/K]
+ * Q = output heat to the air [kW], negative when cooling
+ * Tair_out, Tw_out = output leaving temperatures [degC], may be NULL
+ */
+{
+	int i;
+	for(i = 0; i < n; i++)
+	{
+		double Ca = m_air[i] * cp_moist_air(W[i]);
+		double Cw = m_w[i] * fluid_prop(ft, FLUID_CP, Tw[i], x);
+		double Cmin = fmin(Ca, Cw), Cmax = fmax(Ca, Cw);
+		double eff = hx_eff(type, UA[i] / Cmin, Cmin / Cmax);
+		Q[i] = eff * Cmin * (Tw[i] - Tair[i]);
+		if(Tair_out)
+		{
+			Tair_out[i] = Tair[i] + Q[i] / Ca;
+		}
+		if(Tw_out)
+		{
+			Tw_out[i] = Tw[i] - Q[i] / Cw;
+		}
+	}
+}
+
+
+#endif
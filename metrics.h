@@ -0,0 +1,400 @@
+/*
+ * metrics.h
+ *
+ * Counters and latency histograms of the psych engine in Prometheus text
+ * format.
+ *
+ * Every thread records into its own shard, found through a thread local
+ * pointer, so recording takes no lock and no atomic read-modify-write: the
+ * owner is the only writer and adds with plain loads and stores.  Shards
+ * stay on a global list when their thread ends, and a scrape sums all of
+ * them.  A reader may see a bucket or two of a histogram missing a value
+ * that its sum already holds; the next scrape catches up.  The exported
+ * +Inf bucket and count are summed from the buckets read, so they stay
+ * monotonic.
+ *
+ * Histograms are log-linear like HdrHistogram: 8 buckets per power of two
+ * cover 0 to 2^64 with under 12.5% relative error in 496 counters, and the
+ * bucket of a value is found with one count-leading-zeros.  Latencies are
+ * recorded in ns and exported in seconds.
+ *
+ * -DPSYCH_NO_METRICS keeps the names but turns recording, the clock reads
+ * and metrics_write() into empty functions.
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define METRICS_SUB 3					// sub-bucket bits, 8 buckets per power of two
+#define METRICS_BUCKETS ((64 - METRICS_SUB + 1) << METRICS_SUB)
+
+
+// Counters
+enum
+{
+	METRIC_ROWS,				// rows converted
+	METRIC_ROWS_REJECTED,		// rows without a usable dry bulb or RH
+	METRIC_BATCHES,				// batches through the kernels
+	METRIC_CACHE_HITS,			// pcache chunks reused
+	METRIC_CACHE_MISSES,		// pcache chunks converted
+	METRIC_READINGS,			// MQTT and Modbus readings
+	METRIC_DEVICE_ERRORS,		// Modbus devices that failed a scan
+	METRIC_NCOUNTERS
+};
+
+
+// Histograms
+enum
+{
+	METRIC_BATCH_ROWS,			// rows per batch
+	METRIC_LAT_TREND_FLUSH,		// [ns]
+	METRIC_LAT_PCACHE_CONVERT,
+	METRIC_LAT_MQTT_FLUSH,
+	METRIC_LAT_MODBUS_SCAN,
+	METRIC_LAT_EXPR_CHUNK,
+	METRIC_WETBULB_ITERS,		// Newton steps of wet_bulb()
+	METRIC_NHISTS
+};
+
+
+typedef struct
+{
+	const char *name;
+	const char *labels;			// NULL or label pairs, e.g. fn="x"
+	const char *help;
+	double scale;				// exported value per recorded unit
+	int minexp, maxexp;			// exported buckets: le = 2^minexp .. 2^maxexp units
+} metrics_def;
+
+
+const metrics_def metrics_counter_defs[METRIC_NCOUNTERS] =
+{
+	{"psych_rows_total", NULL, "Rows converted", 1, 0, 0},
+	{"psych_rows_rejected_total", NULL, "Rows without a usable dry bulb or RH", 1, 0, 0},
+	{"psych_batches_total", NULL, "Batches through the psych kernels", 1, 0, 0},
+	{"psych_cache_total", "result=\"hit\"", "Cached chunk lookups", 1, 0, 0},
+	{"psych_cache_total", "result=\"miss\"", "Cached chunk lookups", 1, 0, 0},
+	{"psych_readings_total", NULL, "Sensor readings received over MQTT or Modbus", 1, 0, 0},
+	{"psych_device_errors_total", NULL, "Modbus device scans that failed or timed out", 1, 0, 0},
+};
+
+
+const metrics_def metrics_hist_defs[METRIC_NHISTS] =
+{
+	{"psych_batch_rows", NULL, "Rows per kernel batch", 1, 0, 10},
+	{"psych_latency_seconds", "fn=\"trend_flush\"", "Latency of engine stages", 1E-9, 10, 34},
+	{"psych_latency_seconds", "fn=\"pcache_convert\"", "Latency of engine stages", 1E-9, 10, 34},
+	{"psych_latency_seconds", "fn=\"mqi_flush\"", "Latency of engine stages", 1E-9, 10, 34},
+	{"psych_latency_seconds", "fn=\"mb_scan\"", "Latency of engine stages", 1E-9, 10, 34},
+	{"psych_latency_seconds", "fn=\"expr_chunk\"", "Latency of engine stages", 1E-9, 10, 34},
+	{"psych_wet_bulb_iterations", NULL, "Newton iterations per wet bulb solve", 1, 0, 8},
+};
+
+
+#ifndef PSYCH_NO_METRICS
+
+typedef struct
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bucket[METRICS_BUCKETS];
+} metrics_hist;
+
+
+typedef struct metrics_shard
+{
+	uint64_t counter[METRIC_NCOUNTERS];
+	metrics_hist hist[METRIC_NHISTS];
+	struct metrics_shard *next;
+} metrics_shard;
+
+
+metrics_shard *metrics_shards = NULL;		// all shards, newest first
+__thread metrics_shard *metrics_mine = NULL;	// shard of this thread
+
+
+uint64_t metrics_clock(void)
+/*
+ * Monotonic time [ns]; under strict ISO C, where <time.h> declares no
+ * POSIX clocks, the C11 wall clock instead
+ */
+{
+	struct timespec t;
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+
+int metrics_bucket(uint64_t v)
+/*
+ * Histogram bucket of a value
+ */
+{
+	int e;
+	if(v < (1u << METRICS_SUB))
+	{
+		return (int)v;
+	}
+	e = 63 - __builtin_clzll(v);
+	return ((e - METRICS_SUB + 1) << METRICS_SUB) + (int)(v >> (e - METRICS_SUB) & ((1 << METRICS_SUB) - 1));
+}
+
+
+uint64_t metrics_bucket_low(int i)
+/*
+ * Smallest value of bucket i
+ */
+{
+	int e = (i >> METRICS_SUB) + METRICS_SUB - 1;
+	if(i < (1 << METRICS_SUB))
+	{
+		return i;
+	}
+	return (uint64_t)((1 << METRICS_SUB) + (i & ((1 << METRICS_SUB) - 1))) << (e - METRICS_SUB);
+}
+
+
+metrics_shard *metrics_local(void)
+/*
+ * Shard of the calling thread, created on its first use
+ * Returns NULL only if out of memory; recording is then skipped
+ */
+{
+	metrics_shard *s = metrics_mine;
+	if(s)
+	{
+		return s;
+	}
+	s = (metrics_shard *)calloc(1, sizeof(metrics_shard));
+	if(!s)
+	{
+		return NULL;
+	}
+	s->next = __atomic_load_n(&metrics_shards, __ATOMIC_ACQUIRE);
+	while(!__atomic_compare_exchange_n(&metrics_shards, &s->next, s, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+	{
+	}
+	metrics_mine = s;
+	return s;
+}
+
+
+void metrics_bump(uint64_t *x, uint64_t v)
+/*
+ * Adds v to a counter of the caller's own shard; single writer, so a
+ * relaxed load and store suffice and compile to a plain add
+ */
+{
+	__atomic_store_n(x, __atomic_load_n(x, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+
+void metric_add(int id, uint64_t v)
+/*
+ * Adds v to counter id
+ */
+{
+	metrics_shard *s = metrics_local();
+	if(s)
+	{
+		metrics_bump(&s->counter[id], v);
+	}
+}
+
+
+void metric_observe(int id, uint64_t v)
+/*
+ * Records a value in histogram id
+ */
+{
+	metrics_shard *s = metrics_local();
+	metrics_hist *h;
+	if(!s)
+	{
+		return;
+	}
+	h = &s->hist[id];
+	metrics_bump(&h->bucket[metrics_bucket(v)], 1);
+	metrics_bump(&h->sum, v);
+	if(v > h->max)
+	{
+		__atomic_store_n(&h->max, v, __ATOMIC_RELAXED);
+	}
+	metrics_bump(&h->count, 1);
+}
+
+
+void metrics_snapshot(metrics_shard *out)
+/*
+ * Sums the shards of all threads into out
+ */
+{
+	const metrics_shard *s;
+	int i, k;
+
+	memset(out, 0, sizeof(*out));
+	for(s = __atomic_load_n(&metrics_shards, __ATOMIC_ACQUIRE); s; s = s->next)
+	{
+		for(i = 0; i < METRIC_NCOUNTERS; i++)
+		{
+			out->counter[i] += __atomic_load_n(&s->counter[i], __ATOMIC_RELAXED);
+		}
+		for(i = 0; i < METRIC_NHISTS; i++)
+		{
+			const metrics_hist *h = &s->hist[i];
+			uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+			out->hist[i].count += __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+			out->hist[i].sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+			out->hist[i].max = max > out->hist[i].max ? max : out->hist[i].max;
+			for(k = 0; k < METRICS_BUCKETS; k++)
+			{
+				out->hist[i].bucket[k] += __atomic_load_n(&h->bucket[k], __ATOMIC_RELAXED);
+			}
+		}
+	}
+}
+
+
+double metrics_quantile(const metrics_hist *h, double q)
+/*
+ * Value at quantile q (0 to 1) of a histogram from metrics_snapshot(), in
+ * recorded units; the middle of the bucket holding it
+ */
+{
+	uint64_t n = 0, total = 0, want;
+	int k;
+
+	for(k = 0; k < METRICS_BUCKETS; k++)
+	{
+		total += h->bucket[k];
+	}
+	if(total == 0)
+	{
+		return 0;
+	}
+	want = (uint64_t)(q * (total - 1)) + 1;
+	for(k = 0; k < METRICS_BUCKETS - 1; k++)
+	{
+		n += h->bucket[k];
+		if(n >= want)
+		{
+			break;
+		}
+	}
+	return (metrics_bucket_low(k) + (double)(k < METRICS_BUCKETS - 1 ? metrics_bucket_low(k + 1) : h->max)) / 2;
+}
+
+
+void metrics_head(FILE *f, const metrics_def *d, const metrics_def *prev, const char *type)
+/*
+ * HELP and TYPE lines, once per metric name
+ */
+{
+	if(!prev || strcmp(prev->name, d->name) != 0)
+	{
+		fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", d->name, d->help, d->name, type);
+	}
+}
+
+
+void metrics_write(FILE *f)
+/*
+ * Writes all metrics in the Prometheus text exposition format
+ * Histogram buckets are cumulative at powers of two: le = 2^e - 1
+ * recorded units, i.e. everything below 2^e.
+ */
+{
+	metrics_shard *s = (metrics_shard *)malloc(sizeof(metrics_shard));
+	int i, e, k;
+
+	if(!s)
+	{
+		return;
+	}
+	metrics_snapshot(s);
+	for(i = 0; i < METRIC_NCOUNTERS; i++)
+	{
+		const metrics_def *d = &metrics_counter_defs[i];
+		metrics_head(f, d, i ? d - 1 : NULL, "counter");
+		fprintf(f, "%s%s%s%s %llu\n", d->name, d->labels ? "{" : "", d->labels ? d->labels : "",
+				d->labels ? "}" : "", (unsigned long long)s->counter[i]);
+	}
+	for(i = 0; i < METRIC_NHISTS; i++)
+	{
+		const metrics_def *d = &metrics_hist_defs[i];
+		const metrics_hist *h = &s->hist[i];
+		const char *sep = d->labels ? "," : "";
+		const char *lab = d->labels ? d->labels : "";
+		uint64_t n = 0;
+
+		metrics_head(f, d, i ? d - 1 : NULL, "histogram");
+		k = 0;
+		for(e = d->minexp; e <= d->maxexp; e++)
+		{
+			int end = metrics_bucket((uint64_t)1 << e);
+			for(; k < end; k++)
+			{
+				n += h->bucket[k];
+			}
+			fprintf(f, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", d->name, lab, sep,
+					(double)(((uint64_t)1 << e) - 1) * d->scale, (unsigned long long)n);
+		}
+		// +Inf and _count from the buckets read, not from count, which a
+		// concurrent writer may have moved on from and left below them
+		for(; k < METRICS_BUCKETS; k++)
+		{
+			n += h->bucket[k];
+		}
+		fprintf(f, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", d->name, lab, sep, (unsigned long long)n);
+		fprintf(f, "%s_sum%s%s%s %.9g\n", d->name, d->labels ? "{" : "", lab, d->labels ? "}" : "",
+				(double)h->sum * d->scale);
+		fprintf(f, "%s_count%s%s%s %llu\n", d->name, d->labels ? "{" : "", lab, d->labels ? "}" : "",
+				(unsigned long long)n);
+	}
+	free(s);
+}
+
+
+#else
+
+// -DPSYCH_NO_METRICS: recording and the clock compile to nothing
+uint64_t metrics_clock(void)
+{
+	return 0;
+}
+
+
+void metric_add(int id, uint64_t v)
+{
+	(void)id;
+	(void)v;
+}
+
+
+void metric_observe(int id, uint64_t v)
+{
+	(void)id;
+	(void)v;
+}
+
+
+void metrics_write(FILE *f)
+{
+	(void)f;
+}
+
+#endif
+
+
+#endif
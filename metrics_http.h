@@ -0,0 +1,117 @@
+/*
+ * metrics_http.h
+ *
+ * Scrape endpoint for metrics.h.
+ *
+ * metrics_serve() answers every HTTP request on a TCP port with the
+ * current metrics, from a thread of its own so the engine threads never
+ * wait on a scraper.  One scrape is served at a time, which is all a
+ * Prometheus server asks for.
+ *
+ */
+
+#ifndef METRICS_HTTP_H
+#define METRICS_HTTP_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "metrics.h"
+
+
+void *metrics_http_loop(void *arg)
+{
+	int lfd = (int)(intptr_t)arg;
+	for(;;)
+	{
+		char req[4096], *body = NULL;
+		size_t len = 0, off = 0;
+		struct timeval tv = {1, 0};
+		int fd = accept(lfd, NULL, NULL), n = 0;
+		ssize_t got;
+		FILE *f;
+
+		if(fd < 0)
+		{
+			continue;
+		}
+		// A client that stops sending or reading cannot block scrapes
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		// Read the request head; its path does not matter
+		while(n < (int)sizeof(req) - 1 && (got = recv(fd, req + n, sizeof(req) - 1 - n, 0)) > 0)
+		{
+			n += got;
+			req[n] = 0;
+			if(strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+			{
+				break;
+			}
+		}
+		// Format into memory and send with MSG_NOSIGNAL, so a scraper that
+		// hangs up mid-response costs an EPIPE rather than a SIGPIPE
+		f = open_memstream(&body, &len);
+		if(f)
+		{
+			fputs("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n", f);
+			metrics_write(f);
+			if(fclose(f) == 0)
+			{
+				while(off < len && (got = send(fd, body + off, len - off, MSG_NOSIGNAL)) > 0)
+				{
+					off += got;
+				}
+			}
+			free(body);
+		}
+		close(fd);
+	}
+	return NULL;
+}
+
+
+int metrics_serve(const char *host, int port)
+/*
+ * Starts serving metrics on host:port, e.g. "127.0.0.1" to keep them
+ * local or NULL for all interfaces
+ * Returns 0 on success, -1 if the port cannot be bound
+ */
+{
+	struct addrinfo hints, *res;
+	pthread_t t;
+	char svc[16];
+	int fd, on = 1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	snprintf(svc, sizeof(svc), "%d", port);
+	if(getaddrinfo(host, svc, &hints, &res) != 0)
+	{
+		return -1;
+	}
+	fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, 0);
+	if(fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+			|| bind(fd, res->ai_addr, res->ai_addrlen) != 0 || listen(fd, 8) != 0
+			|| pthread_create(&t, NULL, metrics_http_loop, (void *)(intptr_t)fd) != 0)
+	{
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+		freeaddrinfo(res);
+		return -1;
+	}
+	pthread_detach(t);
+	freeaddrinfo(res);
+	return 0;
+}
+
+
+#endif
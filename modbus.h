@@ -0,0 +1,574 @@
+/*
+ * modbus.h
+ *
+ * Modbus/TCP poller for temperature and humidity transmitters.
+ *
+ * Each sensor names the registers holding its dry bulb and RH on a device
+ * (host, port and unit id).  mb_plan() sorts the registers of every device
+ * and merges them into as few read requests as possible: neighbours closer
+ * than MB_GAP registers share a request, up to the protocol limit of 125
+ * registers.  mb_scan() then polls all devices at once with non-blocking
+ * sockets on one epoll instance, one request in flight per device, so a
+ * scan takes about as long as the slowest device rather than the sum of
+ * all of them.  The scaled readings of all sensors that answered go
+ * through the batch kernels together.
+ *
+ */
+
+#ifndef MODBUS_H
+#define MODBUS_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "psych.h"
+#include "psych_batch.h"
+#include "metrics.h"
+
+#define MB_PORT 502
+#define MB_MAXREGS 125			// registers per read request
+#define MB_GAP 8				// unused registers worth reading to save a request
+#define MB_MAXRANGE 32			// read requests per device
+#define MB_MAXWORDS (MB_MAXRANGE * MB_MAXREGS)
+
+#define MB_HOLDING 3			// function code: read holding registers
+#define MB_INPUT 4				// function code: read input registers
+
+#define MB_IDLE 0
+#define MB_CONNECTING 1
+#define MB_WAITING 2
+#define MB_DONE 3
+#define MB_FAILED 4
+
+
+typedef struct
+{
+	int dev;					// device index
+	int treg, rhreg;			// register addresses (0 based)
+	double tscale, rhscale;		// engineering value = signed register * scale
+	int tword, rhword;			// position of the registers in the device words
+	double Tdb;					// dry bulb [degC]
+	double RH;					// relative humidity [Fraction]
+	double W, h, Tdp;			// derived properties of the last scan
+	int ok;						// the last scan read this sensor
+} mb_sensor;
+
+
+typedef struct
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	int unit;					// Modbus unit id
+	int fc;						// MB_HOLDING or MB_INPUT
+	int fd;
+
+	int nrange;
+	int start[MB_MAXRANGE];		// first register of each request
+	int count[MB_MAXRANGE];		// registers of each request
+	int word[MB_MAXRANGE];		// position of each request's registers in words
+	uint16_t words[MB_MAXWORDS];
+
+	int state;
+	int cur;					// request in flight
+	uint16_t tid;				// its transaction id
+	unsigned char rx[260];
+	int rxlen;
+	long errors;				// failed scans
+} mb_device;
+
+
+typedef struct
+{
+	double P;					// pressure [kPa]
+	int timeout_ms;				// longest a scan waits for a device
+	int epfd;
+	int ndev, devcap;
+	mb_device *dev;
+	int nsensor, sensorcap;
+	mb_sensor *sensor;
+	long requests;				// read requests sent, for checking the grouping
+} mb_poller;
+
+
+double mb_now(void)
+/*
+ * Monotonic time [s]
+ */
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1E-9 * t.tv_nsec;
+}
+
+
+int mb_init(mb_poller *p, double P, int timeout_ms)
+/*
+ * Starts an empty poller
+ * Returns 0 on success, -1 if epoll is unavailable
+ */
+{
+	memset(p, 0, sizeof(*p));
+	p->P = P;
+	p->timeout_ms = timeout_ms;
+	p->epfd = epoll_create1(EPOLL_CLOEXEC);
+	return p->epfd < 0 ? -1 : 0;
+}
+
+
+void mb_close(mb_device *d)
+{
+	if(d->fd >= 0)
+	{
+		close(d->fd);
+	}
+	d->fd = -1;
+}
+
+
+void mb_free(mb_poller *p)
+/*
+ * Closes all connections and frees the poller
+ */
+{
+	int i;
+	for(i = 0; i < p->ndev; i++)
+	{
+		mb_close(&p->dev[i]);
+	}
+	close(p->epfd);
+	free(p->dev);
+	free(p->sensor);
+	memset(p, 0, sizeof(*p));
+}
+
+
+int mb_add_device(mb_poller *p, const char *host, int port, int unit, int fc)
+/*
+ * Adds a device; a device already added with the same host, port and
+ * unit is returned instead of a new one
+ * Returns the device index, -1 if the host does not resolve or out of memory
+ */
+{
+	struct addrinfo hints, *res;
+	char svc[16];
+	mb_device *d;
+	int i;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(svc, sizeof(svc), "%d", port);
+	if(getaddrinfo(host, svc, &hints, &res) != 0)
+	{
+		return -1;
+	}
+	for(i = 0; i < p->ndev; i++)
+	{
+		if(p->dev[i].unit == unit && p->dev[i].fc == fc && p->dev[i].addrlen == res->ai_addrlen
+				&& memcmp(&p->dev[i].addr, res->ai_addr, res->ai_addrlen) == 0)
+		{
+			freeaddrinfo(res);
+			return i;
+		}
+	}
+	if(p->ndev == p->devcap)
+	{
+		int cap = p->devcap ? 2 * p->devcap : 16;
+		mb_device *q = realloc(p->dev, sizeof(mb_device) * cap);
+		if(!q)
+		{
+			freeaddrinfo(res);
+			return -1;
+		}
+		p->dev = q;
+		p->devcap = cap;
+	}
+	d = &p->dev[p->ndev];
+	memset(d, 0, sizeof(*d));
+	memcpy(&d->addr, res->ai_addr, res->ai_addrlen);
+	d->addrlen = res->ai_addrlen;
+	d->unit = unit;
+	d->fc = fc;
+	d->fd = -1;
+	freeaddrinfo(res);
+	return p->ndev++;
+}
+
+
+int mb_add_sensor(mb_poller *p, int dev, int treg, double tscale, int rhreg, double rhscale)
+/*
+ * Adds a sensor reading its dry bulb [degC] from register treg and its RH
+ * [Fraction] from rhreg of device dev, e.g. tscale = 0.1 for tenths of a
+ * degree and rhscale = 0.001 for tenths of a percent
+ * Returns the sensor index, -1 on a bad argument or out of memory
+ */
+{
+	mb_sensor *s;
+	if(dev < 0 || dev >= p->ndev || treg < 0 || treg > 65535 || rhreg < 0 || rhreg > 65535)
+	{
+		return -1;
+	}
+	if(p->nsensor == p->sensorcap)
+	{
+		int cap = p->sensorcap ? 2 * p->sensorcap : 64;
+		mb_sensor *q = realloc(p->sensor, sizeof(mb_sensor) * cap);
+		if(!q)
+		{
+			return -1;
+		}
+		p->sensor = q;
+		p->sensorcap = cap;
+	}
+	s = &p->sensor[p->nsensor];
+	memset(s, 0, sizeof(*s));
+	s->dev = dev;
+	s->treg = treg;
+	s->rhreg = rhreg;
+	s->tscale = tscale;
+	s->rhscale = rhscale;
+	return p->nsensor++;
+}
+
+
+int mb_cmp_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+
+int mb_plan(mb_poller *p)
+/*
+ * Groups the registers of each device into read requests; call after the
+ * last mb_add_sensor()
+ * Returns 0 on success, -1 if a device needs more than MB_MAXRANGE requests
+ */
+{
+	int i, k, r, *reg = malloc(sizeof(int) * 2 * (p->nsensor + 1));
+
+	if(!reg)
+	{
+		return -1;
+	}
+	for(i = 0; i < p->ndev; i++)
+	{
+		mb_device *d = &p->dev[i];
+		int n = 0, m = 0;
+
+		for(k = 0; k < p->nsensor; k++)
+		{
+			if(p->sensor[k].dev == i)
+			{
+				reg[n++] = p->sensor[k].treg;
+				reg[n++] = p->sensor[k].rhreg;
+			}
+		}
+		qsort(reg, n, sizeof(int), mb_cmp_int);
+
+		d->nrange = 0;
+		for(k = 0; k < n; k++)
+		{
+			r = d->nrange - 1;
+			if(r >= 0 && reg[k] < d->start[r] + d->count[r] + MB_GAP && reg[k] - d->start[r] < MB_MAXREGS)
+			{
+				if(reg[k] >= d->start[r] + d->count[r])
+				{
+					m += reg[k] + 1 - d->start[r] - d->count[r];
+					d->count[r] = reg[k] + 1 - d->start[r];
+				}
+				continue;
+			}
+			if(d->nrange == MB_MAXRANGE)
+			{
+				free(reg);
+				return -1;
+			}
+			d->start[d->nrange] = reg[k];
+			d->count[d->nrange] = 1;
+			d->word[d->nrange] = m++;
+			d->nrange++;
+		}
+	}
+	free(reg);
+
+	// Locate each sensor's registers in its device's words
+	for(k = 0; k < p->nsensor; k++)
+	{
+		mb_sensor *s = &p->sensor[k];
+		mb_device *d = &p->dev[s->dev];
+		for(r = 0; r < d->nrange; r++)
+		{
+			if(s->treg >= d->start[r] && s->treg < d->start[r] + d->count[r])
+			{
+				s->tword = d->word[r] + s->treg - d->start[r];
+			}
+			if(s->rhreg >= d->start[r] && s->rhreg < d->start[r] + d->count[r])
+			{
+				s->rhword = d->word[r] + s->rhreg - d->start[r];
+			}
+		}
+	}
+	return 0;
+}
+
+
+int mb_request(mb_poller *p, mb_device *d)
+/*
+ * Sends the read request d->cur
+ * Returns 0 on success, -1 on a socket error
+ */
+{
+	unsigned char q[12];
+	d->tid++;
+	q[0] = d->tid >> 8;
+	q[1] = d->tid & 255;
+	q[2] = 0;
+	q[3] = 0;
+	q[4] = 0;
+	q[5] = 6;
+	q[6] = d->unit;
+	q[7] = d->fc;
+	q[8] = d->start[d->cur] >> 8;
+	q[9] = d->start[d->cur] & 255;
+	q[10] = d->count[d->cur] >> 8;
+	q[11] = d->count[d->cur] & 255;
+	d->rxlen = 0;
+	p->requests++;
+	return send(d->fd, q, sizeof(q), MSG_NOSIGNAL) == (ssize_t)sizeof(q) ? 0 : -1;
+}
+
+
+int mb_start(mb_poller *p, mb_device *d, int i)
+/*
+ * Starts the scan of device i: connects if needed, else sends its first
+ * request
+ * Returns 0 on success, -1 on a socket error
+ */
+{
+	struct epoll_event ev;
+
+	d->cur = 0;
+	if(d->nrange == 0)
+	{
+		d->state = MB_DONE;
+		return 0;
+	}
+	ev.data.u32 = i;
+	if(d->fd < 0)
+	{
+		d->fd = socket(d->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(d->fd < 0)
+		{
+			return -1;
+		}
+		if(connect(d->fd, (struct sockaddr *)&d->addr, d->addrlen) != 0 && errno != EINPROGRESS)
+		{
+			return -1;
+		}
+		ev.events = EPOLLOUT;
+		d->state = MB_CONNECTING;
+		return epoll_ctl(p->epfd, EPOLL_CTL_ADD, d->fd, &ev);
+	}
+	ev.events = EPOLLIN;
+	d->state = MB_WAITING;
+	if(epoll_ctl(p->epfd, EPOLL_CTL_ADD, d->fd, &ev) != 0)
+	{
+		return -1;
+	}
+	return mb_request(p, d);
+}
+
+
+int mb_event(mb_poller *p, mb_device *d, uint32_t events)
+/*
+ * Advances a device on an epoll event
+ * Returns 0 to keep going, -1 on failure
+ */
+{
+	if(events & (EPOLLERR | EPOLLHUP))
+	{
+		return -1;
+	}
+	if(d->state == MB_CONNECTING)
+	{
+		struct epoll_event ev;
+		int err = 0;
+		socklen_t len = sizeof(err);
+		if(getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+		{
+			return -1;
+		}
+		ev.events = EPOLLIN;
+		ev.data.u32 = d - p->dev;
+		d->state = MB_WAITING;
+		if(epoll_ctl(p->epfd, EPOLL_CTL_MOD, d->fd, &ev) != 0)
+		{
+			return -1;
+		}
+		return mb_request(p, d);
+	}
+
+	for(;;)
+	{
+		ssize_t n = recv(d->fd, d->rx + d->rxlen, sizeof(d->rx) - d->rxlen, 0);
+		int need, k;
+		if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			return 0;
+		}
+		if(n <= 0)
+		{
+			return -1;
+		}
+		d->rxlen += n;
+		if(d->rxlen < 9)
+		{
+			continue;
+		}
+		need = 6 + (d->rx[4] << 8 | d->rx[5]);
+		if(need > (int)sizeof(d->rx))
+		{
+			return -1;
+		}
+		if(d->rxlen < need)
+		{
+			continue;
+		}
+
+		// Complete response: check it answers the request in flight
+		if((d->rx[0] << 8 | d->rx[1]) != d->tid || d->rx[7] != d->fc
+				|| d->rx[8] != 2 * d->count[d->cur] || need != 9 + 2 * d->count[d->cur])
+		{
+			return -1;		// exception response or mismatch
+		}
+		for(k = 0; k < d->count[d->cur]; k++)
+		{
+			d->words[d->word[d->cur] + k] = d->rx[9 + 2 * k] << 8 | d->rx[10 + 2 * k];
+		}
+		if(++d->cur == d->nrange)
+		{
+			d->state = MB_DONE;
+			epoll_ctl(p->epfd, EPOLL_CTL_DEL, d->fd, NULL);
+			return 0;
+		}
+		if(mb_request(p, d) != 0)
+		{
+			return -1;
+		}
+	}
+}
+
+
+int mb_scan(mb_poller *p)
+/*
+ * Reads every device once and converts all sensors that answered
+ * Devices that fail or time out are disconnected and retried next scan.
+ * Returns the number of sensors read
+ */
+{
+	struct epoll_event ev[64];
+	double Tdb[256], RH[256], W[256], h[256], Tdp[256];
+	int idx[256];
+	double deadline = mb_now() + p->timeout_ms / 1E3;
+	int i, k, pending = 0, nread = 0;
+	uint64_t t0 = metrics_clock();
+
+	for(i = 0; i < p->ndev; i++)
+	{
+		mb_device *d = &p->dev[i];
+		if(mb_start(p, d, i) != 0)
+		{
+			d->state = MB_FAILED;
+		}
+		pending += d->state != MB_DONE && d->state != MB_FAILED;
+	}
+
+	while(pending > 0)
+	{
+		int wait = (int)(1E3 * (deadline - mb_now()));
+		int n = wait > 0 ? epoll_wait(p->epfd, ev, 64, wait) : 0;
+		if(n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(n <= 0)
+		{
+			break;		// timed out
+		}
+		for(k = 0; k < n; k++)
+		{
+			mb_device *d = &p->dev[ev[k].data.u32];
+			if(d->state != MB_CONNECTING && d->state != MB_WAITING)
+			{
+				continue;
+			}
+			if(mb_event(p, d, ev[k].events) != 0)
+			{
+				d->state = MB_FAILED;
+			}
+			pending -= d->state == MB_DONE || d->state == MB_FAILED;
+		}
+	}
+
+	for(i = 0; i < p->ndev; i++)
+	{
+		mb_device *d = &p->dev[i];
+		if(d->state != MB_DONE)
+		{
+			d->state = MB_FAILED;
+			d->errors++;
+			metric_add(METRIC_DEVICE_ERRORS, 1);
+			mb_close(d);	// also drops it from epoll
+		}
+	}
+
+	// Scale the registers and convert in batches of 256 sensors
+	for(i = 0; i < p->nsensor; i += 256)
+	{
+		int m = 0;
+		for(k = i; k < p->nsensor && k < i + 256; k++)
+		{
+			mb_sensor *s = &p->sensor[k];
+			const mb_device *d = &p->dev[s->dev];
+			s->ok = d->state == MB_DONE;
+			if(s->ok)
+			{
+				s->Tdb = (int16_t)d->words[s->tword] * s->tscale;
+				s->RH = (int16_t)d->words[s->rhword] * s->rhscale;
+				Tdb[m] = s->Tdb;
+				RH[m] = s->RH;
+				idx[m++] = k;
+			}
+		}
+		if(m == 0)
+		{
+			continue;
+		}
+		hum_rat2_batch(Tdb, RH, p->P, W, m);
+		enthalpy_air_h2o_batch(Tdb, W, h, m);
+		dew_point_batch(p->P, W, Tdp, m);
+		for(k = 0; k < m; k++)
+		{
+			p->sensor[idx[k]].W = W[k];
+			p->sensor[idx[k]].h = h[k];
+			p->sensor[idx[k]].Tdp = Tdp[k];
+		}
+		nread += m;
+		metric_add(METRIC_BATCHES, 1);
+		metric_observe(METRIC_BATCH_ROWS, m);
+	}
+	metric_add(METRIC_READINGS, 2 * nread);
+	metric_add(METRIC_ROWS, nread);
+	metric_observe(METRIC_LAT_MODBUS_SCAN, metrics_clock() - t0);
+	return nread;
+}
+
+
+#endif
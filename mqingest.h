@@ -0,0 +1,333 @@
+/*
+ * mqingest.h
+ *
+ * MQTT sensor ingest for the psych pipeline.
+ *
+ * Sensors publish dry bulb and relative humidity on separate topics that
+ * share a prefix, e.g. "bldg1/ahu2/sa/temp" and "bldg1/ahu2/sa/rh".  The
+ * adapter subscribes to topic filters, creates a point for every prefix
+ * it sees, and decodes each payload as a plain number or the "value"
+ * member of a JSON object.  A point whose reading changed is queued once;
+ * when the queue holds a full batch, or flush_ms has passed, the latest
+ * readings of the queued points go through the batch kernels and one
+ * message per point ({"W":..,"h":..,"Tdp":..} on prefix + out_suffix) is
+ * published.  The whole batch leaves in a single mqtt_flush().
+ *
+ */
+
+#ifndef MQINGEST_H
+#define MQINGEST_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include "psych.h"
+#include "psych_batch.h"
+#include "metrics.h"
+#include "csvscan.h"
+#include "mqtt.h"
+
+#define MQI_BATCH 256			// largest batch of points converted together
+#define MQI_TOPIC 256			// longest point prefix
+#define MQI_HASH 4096			// slots of the point index, a power of 2
+
+
+typedef struct
+{
+	char prefix[MQI_TOPIC];
+	double Tdb;					// latest dry bulb [degC]
+	double RH;					// latest relative humidity [Fraction]
+	int have;					// 1 = Tdb seen, 2 = RH seen
+	int queued;
+} mqi_point;
+
+
+typedef struct
+{
+	// Configuration, set after mqi_init()
+	const char *tsuffix;		// dry bulb topic suffix, default "/temp"
+	const char *rhsuffix;		// RH topic suffix, default "/rh"
+	const char *out_suffix;		// suffix of the derived topic, default "/psych"
+	double P;					// pressure [kPa]
+	int fahrenheit;				// dry bulb in F instead of degC
+	int percent;				// RH in % instead of a fraction
+	int batch;					// points per batch, 1 to MQI_BATCH
+	int flush_ms;				// longest time a reading waits in the queue [ms]
+
+	mqtt_conn *c;
+	int n;						// points
+	int cap;
+	mqi_point *pt;
+	int index[MQI_HASH];		// point of each slot, -1 if empty
+	int nq;						// queued points
+	int queue[MQI_BATCH];
+	double last_flush;
+	int failed;					// a flush from mqi_message() lost the connection
+
+	long readings;				// payloads decoded
+	long bad;					// payloads or topics that could not be used
+	long published;				// derived messages published
+} mqi_state;
+
+
+void mqi_init(mqi_state *m, mqtt_conn *c, double P)
+/*
+ * Sets up an adapter on a connected client with the default suffixes,
+ * a batch of 64 points and a 1 s flush interval
+ */
+{
+	int i;
+	memset(m, 0, sizeof(*m));
+	m->c = c;
+	m->P = P;
+	m->tsuffix = "/temp";
+	m->rhsuffix = "/rh";
+	m->out_suffix = "/psych";
+	m->batch = 64;
+	m->flush_ms = 1000;
+	for(i = 0; i < MQI_HASH; i++)
+	{
+		m->index[i] = -1;
+	}
+	m->last_flush = mqtt_now();
+}
+
+
+void mqi_free(mqi_state *m)
+/*
+ * Frees the points
+ */
+{
+	free(m->pt);
+	m->pt = NULL;
+	m->n = m->cap = 0;
+}
+
+
+int mqi_point_find(mqi_state *m, const char *prefix, int len)
+/*
+ * Index of the point of a topic prefix of len bytes, created if new
+ * Returns -1 if the prefix is too long or the index is full
+ */
+{
+	uint32_t h = 2166136261u;
+	int k, slot;
+
+	if(len >= MQI_TOPIC)
+	{
+		return -1;
+	}
+	for(k = 0; k < len; k++)
+	{
+		h = (h ^ (unsigned char)prefix[k]) * 16777619u;
+	}
+	for(k = 0; k < MQI_HASH; k++)
+	{
+		slot = (h + k) & (MQI_HASH - 1);
+		if(m->index[slot] < 0)
+		{
+			break;
+		}
+		if(strncmp(m->pt[m->index[slot]].prefix, prefix, len) == 0 && m->pt[m->index[slot]].prefix[len] == 0)
+		{
+			return m->index[slot];
+		}
+	}
+	if(k == MQI_HASH || 2 * m->n >= MQI_HASH)
+	{
+		return -1;		// keep the index at most half full
+	}
+
+	if(m->n == m->cap)
+	{
+		int cap = m->cap ? 2 * m->cap : 64;
+		mqi_point *p = realloc(m->pt, sizeof(mqi_point) * cap);
+		if(!p)
+		{
+			return -1;
+		}
+		m->pt = p;
+		m->cap = cap;
+	}
+	memset(&m->pt[m->n], 0, sizeof(mqi_point));
+	memcpy(m->pt[m->n].prefix, prefix, len);
+	m->index[slot] = m->n;
+	return m->n++;
+}
+
+
+int mqi_decode(const char *payload, int len, double *v)
+/*
+ * Reading of a payload: a number, or the "value" member of a JSON object
+ * Returns 0 on success, -1 if there is no number
+ */
+{
+	const char *p = payload, *end = payload + len;
+	while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+	{
+		p++;
+	}
+	if(p < end && *p == '{')
+	{
+		const char *key = NULL;
+		for(; p + 7 <= end; p++)
+		{
+			if(memcmp(p, "\"value\"", 7) == 0)
+			{
+				key = p + 7;
+				break;
+			}
+		}
+		if(!key)
+		{
+			return -1;
+		}
+		for(p = key; p < end && (*p == ' ' || *p == ':'); p++)
+		{
+		}
+		if(p < end && *p == '"')
+		{
+			p++;		// value sent as a string
+		}
+	}
+	return csv_atof(p, end, v) ? 0 : -1;
+}
+
+
+int mqi_flush(mqi_state *m)
+/*
+ * Converts the queued points and publishes their derived properties
+ * Returns 0 on success, -1 if the connection failed
+ */
+{
+	double Tdb[MQI_BATCH], RH[MQI_BATCH], W[MQI_BATCH], h[MQI_BATCH], Tdp[MQI_BATCH];
+	int k, n = m->nq < MQI_BATCH ? m->nq : MQI_BATCH;		// bounded, so only n entries are read
+	uint64_t t0 = metrics_clock();
+
+	m->last_flush = mqtt_now();
+	if(n <= 0)
+	{
+		return 0;
+	}
+	for(k = 0; k < n; k++)
+	{
+		mqi_point *p = &m->pt[m->queue[k]];
+		Tdb[k] = p->Tdb;
+		RH[k] = p->RH;
+		p->queued = 0;
+	}
+	m->nq = 0;
+	hum_rat2_batch(Tdb, RH, m->P, W, n);
+	enthalpy_air_h2o_batch(Tdb, W, h, n);
+	dew_point_batch(m->P, W, Tdp, n);
+
+	for(k = 0; k < n; k++)
+	{
+		char topic[MQI_TOPIC + 64], msg[128];
+		int len;
+		snprintf(topic, sizeof(topic), "%s%s", m->pt[m->queue[k]].prefix, m->out_suffix);
+		len = snprintf(msg, sizeof(msg), "{\"W\":%.6f,\"h\":%.3f,\"Tdp\":%.2f}", W[k], h[k], Tdp[k]);
+		if(mqtt_publish(m->c, topic, msg, len, 0) != 0)
+		{
+			return -1;
+		}
+		m->published++;
+	}
+	k = mqtt_flush(m->c);
+	metric_add(METRIC_ROWS, n);
+	metric_add(METRIC_BATCHES, 1);
+	metric_observe(METRIC_BATCH_ROWS, n);
+	metric_observe(METRIC_LAT_MQTT_FLUSH, metrics_clock() - t0);
+	return k;
+}
+
+
+void mqi_message(const char *topic, const char *payload, int len, void *ctx)
+/*
+ * mqtt_msg_fn of the adapter, ctx is the mqi_state
+ */
+{
+	mqi_state *m = ctx;
+	int tl = (int)strlen(topic);
+	int ts = (int)strlen(m->tsuffix), rs = (int)strlen(m->rhsuffix);
+	int which, i;
+	double v;
+	mqi_point *p;
+
+	if(tl > ts && strcmp(topic + tl - ts, m->tsuffix) == 0)
+	{
+		which = 1;
+		tl -= ts;
+	}
+	else if(tl > rs && strcmp(topic + tl - rs, m->rhsuffix) == 0)
+	{
+		which = 2;
+		tl -= rs;
+	}
+	else
+	{
+		return;		// not a reading, e.g. our own derived messages
+	}
+	if(mqi_decode(payload, len, &v) != 0 || (i = mqi_point_find(m, topic, tl)) < 0)
+	{
+		m->bad++;
+		return;
+	}
+	m->readings++;
+	metric_add(METRIC_READINGS, 1);
+
+	p = &m->pt[i];
+	if(which == 1)
+	{
+		p->Tdb = m->fahrenheit ? (v - 32) / 1.8 : v;
+	}
+	else
+	{
+		p->RH = m->percent ? v / 100 : v;
+	}
+	p->have |= which;
+	if(p->have == 3 && !p->queued)
+	{
+		p->queued = 1;
+		m->queue[m->nq++] = i;
+		if((m->nq >= m->batch || m->nq == MQI_BATCH) && mqi_flush(m) != 0)
+		{
+			m->failed = 1;		// mqi_run() sees it after this poll
+		}
+	}
+}
+
+
+int mqi_run(mqi_state *m, const char *const *filter, int nfilter, volatile sig_atomic_t *stop)
+/*
+ * Subscribes to the topic filters and converts readings until *stop
+ * becomes non zero, then publishes what is still queued
+ * Returns 0 when stopped, -1 if the connection failed
+ */
+{
+	int k;
+	for(k = 0; k < nfilter; k++)
+	{
+		if(mqtt_subscribe(m->c, filter[k]) != 0)
+		{
+			return -1;
+		}
+	}
+	while(!*stop)
+	{
+		double wait = m->flush_ms - 1E3 * (mqtt_now() - m->last_flush);
+		if(mqtt_poll(m->c, wait > 0 ? (int)wait : 0, mqi_message, m) < 0 || m->failed)
+		{
+			return -1;
+		}
+		if(1E3 * (mqtt_now() - m->last_flush) >= m->flush_ms && mqi_flush(m) != 0)
+		{
+			return -1;
+		}
+	}
+	return mqi_flush(m);
+}
+
+
+#endif
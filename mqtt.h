@@ -0,0 +1,432 @@
+/*
+ * mqtt.h
+ *
+ * Minimal MQTT 3.1.1 client over a TCP socket.
+ *
+ * Covers what sensor ingest needs: connect with a clean session,
+ * subscribe at QoS 0, receive publishes, publish at QoS 0 and keep the
+ * connection alive.  Outgoing packets are collected in a transmit buffer
+ * and written with one send() by mqtt_flush(), so a batch of derived
+ * values costs one system call and one TCP segment train rather than one
+ * round trip per value.
+ *
+ */
+
+#ifndef MQTT_H
+#define MQTT_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define MQTT_BUF 65536			// receive and transmit buffers, also the largest packet
+#define MQTT_PORT 1883
+
+#define MQTT_CONNECT 1
+#define MQTT_CONNACK 2
+#define MQTT_PUBLISH 3
+#define MQTT_PUBACK 4
+#define MQTT_SUBSCRIBE 8
+#define MQTT_SUBACK 9
+#define MQTT_PINGREQ 12
+#define MQTT_PINGRESP 13
+#define MQTT_DISCONNECT 14
+
+
+typedef struct
+{
+	int fd;
+	int keepalive;					// [s], 0 disables pings
+	double last_tx;					// time of the last packet sent [s]
+	uint16_t id;					// last packet identifier used
+	int rxlen;
+	int txlen;
+	unsigned char rx[MQTT_BUF];
+	unsigned char tx[MQTT_BUF];
+	long received;					// publishes received
+	long sent;						// publishes sent
+} mqtt_conn;
+
+
+/*
+ * Called by mqtt_poll() for each publish received
+ * topic is NUL terminated; payload is not, it has len bytes
+ */
+typedef void (*mqtt_msg_fn)(const char *topic, const char *payload, int len, void *ctx);
+
+
+double mqtt_now(void)
+/*
+ * Monotonic time [s]
+ */
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1E-9 * t.tv_nsec;
+}
+
+
+int mqtt_flush(mqtt_conn *c)
+/*
+ * Sends the transmit buffer
+ * Returns 0 on success, -1 if the connection failed
+ */
+{
+	int off = 0;
+	while(off < c->txlen)
+	{
+		ssize_t n = send(c->fd, c->tx + off, c->txlen - off, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(n <= 0)
+		{
+			return -1;
+		}
+		off += n;
+	}
+	c->txlen = 0;
+	c->last_tx = mqtt_now();
+	return 0;
+}
+
+
+int mqtt_packet(mqtt_conn *c, int head, const void *a, int alen, const void *b, int blen)
+/*
+ * Queues a packet of fixed header byte head with the body a followed by b
+ * Flushes first if the packet does not fit behind the queued ones.
+ * Returns 0 on success, -1 if it is too large or the connection failed
+ */
+{
+	int rem = alen + blen, n = 0, r;
+	unsigned char hdr[5];
+
+	hdr[n++] = head;
+	r = rem;
+	do
+	{
+		hdr[n] = r % 128;
+		r /= 128;
+		hdr[n++] |= r ? 128 : 0;
+	}
+	while(r && n < 5);
+
+	if(n + rem > MQTT_BUF)
+	{
+		return -1;
+	}
+	if(c->txlen + n + rem > MQTT_BUF && mqtt_flush(c) != 0)
+	{
+		return -1;
+	}
+	memcpy(c->tx + c->txlen, hdr, n);
+	if(alen)
+	{
+		memcpy(c->tx + c->txlen + n, a, alen);
+	}
+	if(blen)
+	{
+		memcpy(c->tx + c->txlen + n + alen, b, blen);
+	}
+	c->txlen += n + rem;
+	return 0;
+}
+
+
+int mqtt_str(unsigned char *p, const char *s)
+/*
+ * Writes an MQTT string (16 bit length, then the bytes), returns its size
+ */
+{
+	int n = (int)strlen(s);
+	p[0] = n >> 8;
+	p[1] = n & 255;
+	memcpy(p + 2, s, n);
+	return n + 2;
+}
+
+
+int mqtt_next(mqtt_conn *c, int *type, int *flags, unsigned char **body, int *len)
+/*
+ * Finds the first complete packet in the receive buffer
+ * Returns its total size, 0 if it is not complete yet, -1 if malformed
+ */
+{
+	int n = 1, rem = 0, mult = 1;
+	while(1)
+	{
+		if(n >= c->rxlen)
+		{
+			return 0;
+		}
+		rem += (c->rx[n] & 127) * mult;
+		mult *= 128;
+		if(!(c->rx[n++] & 128))
+		{
+			break;
+		}
+		if(n == 5)
+		{
+			return -1;
+		}
+	}
+	if(n + rem > MQTT_BUF)
+	{
+		return -1;
+	}
+	if(n + rem > c->rxlen)
+	{
+		return 0;
+	}
+	*type = c->rx[0] >> 4;
+	*flags = c->rx[0] & 15;
+	*body = c->rx + n;
+	*len = rem;
+	return n + rem;
+}
+
+
+int mqtt_read(mqtt_conn *c, int timeout_ms)
+/*
+ * Waits up to timeout_ms for data and appends it to the receive buffer
+ * Returns the bytes read (0 on timeout), -1 if the connection closed
+ */
+{
+	struct pollfd p;
+	ssize_t n;
+
+	p.fd = c->fd;
+	p.events = POLLIN;
+	n = poll(&p, 1, timeout_ms);
+	if(n < 0)
+	{
+		return errno == EINTR ? 0 : -1;
+	}
+	if(n == 0)
+	{
+		return 0;
+	}
+	n = recv(c->fd, c->rx + c->rxlen, MQTT_BUF - c->rxlen, 0);
+	if(n < 0 && errno == EINTR)
+	{
+		return 0;
+	}
+	if(n <= 0)
+	{
+		return -1;
+	}
+	c->rxlen += n;
+	return (int)n;
+}
+
+
+int mqtt_connect(mqtt_conn *c, const char *host, int port, const char *client_id, int keepalive)
+/*
+ * Opens a connection to a broker and waits up to 5 s for its CONNACK
+ * keepalive = ping interval agreed with the broker [s]
+ * Returns 0 on success, -1 on a network error or a refused connection
+ */
+{
+	struct addrinfo hints, *res, *ai;
+	char svc[16];
+	unsigned char v[300];
+	int n = 0, type, flags, len, size;
+	unsigned char *body;
+	double t0;
+
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+	c->keepalive = keepalive;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(svc, sizeof(svc), "%d", port);
+	if(strlen(client_id) > 200 || getaddrinfo(host, svc, &hints, &res) != 0)
+	{
+		return -1;
+	}
+	for(ai = res; ai; ai = ai->ai_next)
+	{
+		c->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(c->fd >= 0 && connect(c->fd, ai->ai_addr, ai->ai_addrlen) == 0)
+		{
+			break;
+		}
+		if(c->fd >= 0)
+		{
+			close(c->fd);
+		}
+		c->fd = -1;
+	}
+	freeaddrinfo(res);
+	if(c->fd < 0)
+	{
+		return -1;
+	}
+
+	n += mqtt_str(v, "MQTT");
+	v[n++] = 4;						// protocol level 3.1.1
+	v[n++] = 2;						// clean session
+	v[n++] = keepalive >> 8;
+	v[n++] = keepalive & 255;
+	n += mqtt_str(v + n, client_id);
+	if(mqtt_packet(c, MQTT_CONNECT << 4, v, n, NULL, 0) != 0 || mqtt_flush(c) != 0)
+	{
+		close(c->fd);
+		c->fd = -1;
+		return -1;
+	}
+
+	t0 = mqtt_now();
+	while(mqtt_now() - t0 < 5)
+	{
+		if(mqtt_read(c, 100) < 0)
+		{
+			break;
+		}
+		size = mqtt_next(c, &type, &flags, &body, &len);
+		if(size < 0)
+		{
+			break;
+		}
+		if(size > 0)
+		{
+			int ok = type == MQTT_CONNACK && len == 2 && body[1] == 0;
+			c->rxlen -= size;
+			memmove(c->rx, c->rx + size, c->rxlen);
+			if(ok)
+			{
+				return 0;
+			}
+			break;
+		}
+	}
+	close(c->fd);
+	c->fd = -1;
+	return -1;
+}
+
+
+int mqtt_subscribe(mqtt_conn *c, const char *filter)
+/*
+ * Queues a QoS 0 subscription to a topic filter (+ and # wildcards)
+ * and sends it; the SUBACK is consumed by mqtt_poll()
+ * Returns 0 on success, -1 on error
+ */
+{
+	unsigned char v[1030];
+	int n = 2;
+	if(strlen(filter) > 1024)
+	{
+		return -1;
+	}
+	c->id = c->id == 65535 ? 1 : c->id + 1;
+	v[0] = c->id >> 8;
+	v[1] = c->id & 255;
+	n += mqtt_str(v + n, filter);
+	v[n++] = 0;
+	if(mqtt_packet(c, MQTT_SUBSCRIBE << 4 | 2, v, n, NULL, 0) != 0)
+	{
+		return -1;
+	}
+	return mqtt_flush(c);
+}
+
+
+int mqtt_publish(mqtt_conn *c, const char *topic, const void *payload, int len, int retain)
+/*
+ * Queues a QoS 0 publish; it is sent by the next mqtt_flush(), or earlier
+ * when the transmit buffer fills
+ * Returns 0 on success, -1 on error
+ */
+{
+	unsigned char t[1024];
+	if(strlen(topic) > sizeof(t) - 2)
+	{
+		return -1;
+	}
+	c->sent++;
+	return mqtt_packet(c, MQTT_PUBLISH << 4 | (retain ? 1 : 0), t, mqtt_str(t, topic), payload, len);
+}
+
+
+int mqtt_poll(mqtt_conn *c, int timeout_ms, mqtt_msg_fn fn, void *ctx)
+/*
+ * Waits up to timeout_ms for packets and handles all complete ones,
+ * calling fn for each publish; sends a ping when the keepalive is due
+ * Returns the number of publishes received, -1 if the connection failed
+ */
+{
+	int got = 0, size, type, flags, len;
+	unsigned char *body;
+
+	if(mqtt_read(c, timeout_ms) < 0)
+	{
+		return -1;
+	}
+	while((size = mqtt_next(c, &type, &flags, &body, &len)) > 0)
+	{
+		if(type == MQTT_PUBLISH && len >= 2)
+		{
+			int tlen = body[0] << 8 | body[1];
+			int qos = flags >> 1 & 3;
+			int off = 2 + tlen + (qos ? 2 : 0);
+			if(off <= len)
+			{
+				char topic[1024];
+				int n = tlen < (int)sizeof(topic) - 1 ? tlen : (int)sizeof(topic) - 1;
+				memcpy(topic, body + 2, n);
+				topic[n] = 0;
+				if(qos == 1)
+				{
+					mqtt_packet(c, MQTT_PUBACK << 4, body + 2 + tlen, 2, NULL, 0);
+				}
+				c->received++;
+				got++;
+				fn(topic, (const char *)body + off, len - off, ctx);
+			}
+		}
+		c->rxlen -= size;
+		memmove(c->rx, c->rx + size, c->rxlen);
+	}
+	if(size < 0)
+	{
+		return -1;
+	}
+	if(c->keepalive && mqtt_now() - c->last_tx > c->keepalive / 2.0)
+	{
+		mqtt_packet(c, MQTT_PINGREQ << 4, NULL, 0, NULL, 0);
+	}
+	if(c->txlen && mqtt_flush(c) != 0)
+	{
+		return -1;
+	}
+	return got;
+}
+
+
+void mqtt_close(mqtt_conn *c)
+/*
+ * Flushes queued packets, disconnects and closes the socket
+ */
+{
+	if(c->fd < 0)
+	{
+		return;
+	}
+	mqtt_packet(c, MQTT_DISCONNECT << 4, NULL, 0, NULL, 0);
+	mqtt_flush(c);
+	close(c->fd);
+	c->fd = -1;
+}
+
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * pcache.h
+ *
+ * Incremental recompute cache keyed on input content hashes.
+ *
+ * A trend log is split into chunks of up to PCACHE_CHUNK bytes, each cut
+ * after the last complete line in its window, so the boundaries depend
+ * only on the bytes before them and appending a day of data leaves all
+ * earlier chunks unchanged.  Each chunk is hashed (64 bit FNV-1a, seeded
+ * with the processing options) and its derived output is stored in the
+ * cache directory under that hash.  A re-run copies the stored output of
+ * every chunk it has seen before and converts only new or changed chunks.
+ *
+ */
+
+#ifndef PCACHE_H
+#define PCACHE_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trend.h"
+#include "metrics.h"
+
+#define PCACHE_CHUNK (1 << 20)	// chunk window [bytes]
+
+
+typedef struct
+{
+	long chunks;		// chunks in the input
+	long hits;			// chunks served from the cache
+	long misses;		// chunks converted
+} pcache_stats;
+
+
+uint64_t pcache_hash(const void *data, size_t n, uint64_t h)
+/*
+ * 64 bit FNV-1a of n bytes, continuing from h
+ * Start a new hash with h = 14695981039346656037
+ */
+{
+	const unsigned char *p = data;
+	size_t i;
+	for(i = 0; i < n; i++)
+	{
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+
+uint64_t pcache_seed(const trend_reader *cfg)
+/*
+ * Hash of the options that change the output, so a cache entry is never
+ * served for a run with a different pressure, column or unit setting
+ */
+{
+	uint64_t h = 14695981039346656037ULL;
+	h = pcache_hash(&cfg->P, sizeof(cfg->P), h);
+	h = pcache_hash(&cfg->tcol, sizeof(cfg->tcol), h);
+	h = pcache_hash(&cfg->rhcol, sizeof(cfg->rhcol), h);
+	h = pcache_hash(&cfg->fahrenheit, sizeof(cfg->fahrenheit), h);
+	h = pcache_hash(&cfg->percent, sizeof(cfg->percent), h);
+	return h;
+}
+
+
+int pcache_copy(const char *path, FILE *out)
+/*
+ * Appends a cached chunk output to out
+ * Returns 0 on success, -1 if the entry is missing or unreadable
+ */
+{
+	char buf[65536];
+	size_t n;
+	FILE *f = fopen(path, "rb");
+	if(!f)
+	{
+		return -1;
+	}
+	while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+	{
+		if(fwrite(buf, 1, n, out) != n)
+		{
+			fclose(f);
+			return -1;
+		}
+	}
+	n = ferror(f);
+	fclose(f);
+	return n ? -1 : 0;
+}
+
+
+int pcache_convert(trend_reader *r, const char *chunk, size_t len, int first, int last, const char *path)
+/*
+ * Converts one chunk with the options of r into a new cache entry
+ * first = the chunk starts the log, so its first line may be the header
+ * last = the chunk ends the log, so a last line without a newline is a row
+ * (as with trend_finish()); otherwise no such line is converted.
+ * The entry is written to a temporary name and renamed, so an interrupted
+ * run never leaves a partial entry behind.
+ * Returns 0 on success, -1 on I/O error
+ */
+{
+	char tmp[4096];
+	size_t start = 0;
+	const char *nl;
+	FILE *f;
+	uint64_t t0 = metrics_clock();
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "wb");
+	if(!f)
+	{
+		return -1;
+	}
+
+	// Every chunk starts from a clean reader so its output depends only on its bytes
+	r->out = f;
+	r->offset = 0;
+	r->rows = 0;
+	r->skipped = 0;
+	r->header = first;
+	r->nb = 0;
+	while((nl = memchr(chunk + start, '\n', len - start)) != NULL)
+	{
+		trend_line(r, chunk + start, (int)(nl - chunk - start));
+		start = nl - chunk + 1;
+	}
+	if(last && start < len)
+	{
+		trend_line(r, chunk + start, (int)(len - start));
+	}
+	trend_flush(r);
+
+	if(fclose(f) != 0 || rename(tmp, path) != 0)
+	{
+		remove(tmp);
+		return -1;
+	}
+	metric_observe(METRIC_LAT_PCACHE_CONVERT, metrics_clock() - t0);
+	return 0;
+}
+
+
+int pcache_run(trend_reader *cfg, const char *input, const char *cachedir, FILE *out, pcache_stats *st)
+/*
+ * Writes the converted trend log to out, reusing cached chunk outputs
+ * cfg = options (P, tcol, rhcol, fahrenheit, percent), e.g. from
+ *       trend_open(); its out and counters are used as scratch
+ * cachedir = existing directory for the cache entries
+ * st = output statistics, may be NULL
+ * Returns 0 on success, -1 on I/O error
+ */
+{
+	FILE *in = fopen(input, "rb"), *cfg_out = cfg->out;
+	char *buf = malloc(PCACHE_CHUNK);
+	char path[4096];
+	uint64_t seed = pcache_seed(cfg);
+	size_t len = 0;
+	pcache_stats s = {0, 0, 0};
+	int err = 0;
+
+	if(!in || !buf)
+	{
+		if(in)
+		{
+			fclose(in);
+		}
+		free(buf);
+		return -1;
+	}
+
+	for(;;)
+	{
+		size_t cut, got = fread(buf + len, 1, PCACHE_CHUNK - len, in);
+		uint64_t h;
+		int eof = 0;
+
+		len += got;
+		if(len == 0)
+		{
+			break;
+		}
+		if(len == PCACHE_CHUNK)
+		{
+			// Cut after the last newline in the window
+			for(cut = len; cut > 0 && buf[cut - 1] != '\n'; cut--)
+			{
+			}
+			if(cut == 0)
+			{
+				cut = len;	// one line longer than a chunk
+			}
+		}
+		else
+		{
+			cut = len;		// end of file
+			eof = 1;
+		}
+
+		// The first chunk is keyed apart: only there is a bad first line a header
+		h = pcache_hash(buf, cut, s.chunks == 0 ? ~seed : seed);
+		if(eof && buf[cut - 1] != '\n')
+		{
+			h = pcache_hash("\n", 1, h);	// end of file ends the last line, keyed as its newline
+		}
+		snprintf(path, sizeof(path), "%s/%016llx.out", cachedir, (unsigned long long)h);
+		s.chunks++;
+		if(pcache_copy(path, out) == 0)
+		{
+			s.hits++;
+			metric_add(METRIC_CACHE_HITS, 1);
+		}
+		else
+		{
+			s.misses++;
+			metric_add(METRIC_CACHE_MISSES, 1);
+			PSYCH_PROBE2(cache_miss, h, cut);
+			if(pcache_convert(cfg, buf, cut, s.chunks == 1, eof, path) != 0 || pcache_copy(path, out) != 0)
+			{
+				err = -1;
+				break;
+			}
+		}
+
+		memmove(buf, buf + cut, len - cut);
+		len -= cut;
+		if(got == 0 && len == 0)
+		{
+			break;
+		}
+	}
+
+	if(ferror(in))
+	{
+		err = -1;
+	}
+	fclose(in);
+	free(buf);
+	cfg->out = cfg_out;
+	if(st)
+	{
+		*st = s;
+	}
+	return err;
+}
+
+
+#endif
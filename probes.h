@@ -0,0 +1,125 @@
+/*
+ * probes.h
+ *
+ * USDT tracepoints of the psych engine for perf, bpftrace and SystemTap.
+ *
+ * A probe compiles to a single nop plus an ELF note (.note.stapsdt) that
+ * tells the tracer where the nop is and where its arguments live.  A
+ * tracer that attaches patches the nop into a breakpoint; unattached the
+ * cost is the nop and keeping the arguments in registers.  <sys/sdt.h>
+ * is used when it is installed; otherwise the same notes are emitted
+ * here for x86-64 and AArch64, and elsewhere, or with -DPSYCH_NO_PROBES,
+ * the probes compile to nothing.
+ *
+ * All arguments are 64 bit signed integers, since tracers read
+ * floating point arguments poorly: temperatures are in mdegC, RH in parts
+ * per million, humidity ratio errors in ug/kg, names are pointers to C
+ * strings.  Doubles go through psych_probe_int(), which saturates them
+ * and maps NaN to INT64_MIN.
+ *
+ *   psych:batch_entry(name, n)        a batch kernel starts on n rows
+ *   psych:batch_exit(name, n)         and returns
+ *   psych:wet_bulb_iter(iter, Tdb, RH, Twb, Werr)
+ *                                     one Newton step of wet_bulb()
+ *   psych:cache_miss(hash, bytes)     pcache converts a chunk
+ *
+ * e.g. bpftrace -e 'usdt:./psych:psych:batch_entry { @[str(arg0)] = hist(arg1); }'
+ *
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+#include <stdint.h>
+
+#if defined(PSYCH_NO_PROBES)
+#define PSYCH_PROBES 0
+#elif defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PSYCH_PROBES 1
+#endif
+#endif
+
+#if !defined(PSYCH_PROBES) && defined(__GNUC__) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+#define PSYCH_PROBES 2
+#endif
+
+#ifndef PSYCH_PROBES
+#define PSYCH_PROBES 0
+#endif
+
+
+int64_t psych_probe_int(double x)
+/*
+ * Probe argument from a double: converting NaN or a value outside int64_t
+ * with a plain cast is undefined, so NaN gives INT64_MIN and out of range
+ * values saturate
+ */
+{
+	if(!(x == x))
+	{
+		return INT64_MIN;
+	}
+	if(x >= 9.2E18)
+	{
+		return INT64_MAX;
+	}
+	return x <= -9.2E18 ? INT64_MIN : (int64_t)x;
+}
+
+
+#if PSYCH_PROBES == 1
+
+#define PSYCH_PROBE2(name, a, b) \
+	DTRACE_PROBE2(psych, name, (int64_t)(a), (int64_t)(b))
+#define PSYCH_PROBE5(name, a, b, c, d, e) \
+	DTRACE_PROBE5(psych, name, (int64_t)(a), (int64_t)(b), (int64_t)(c), (int64_t)(d), (int64_t)(e))
+
+#elif PSYCH_PROBES == 2
+
+/*
+ * The note layout of <sys/sdt.h> version 3: address of the nop, address
+ * of _.stapsdt.base (lets the tracer correct for prelinking), semaphore
+ * (none), provider, name, and the argument string "-8@<operand> ...".
+ */
+#define PSYCH_PROBE_NOTE(name, args) \
+	"990:	nop\n" \
+	".pushsection .note.stapsdt,\"\",\"note\"\n" \
+	".balign 4\n" \
+	".4byte 992f-991f, 994f-993f, 3\n" \
+	"991:	.asciz \"stapsdt\"\n" \
+	"992:	.balign 4\n" \
+	"993:	.8byte 990b\n" \
+	".8byte _.stapsdt.base\n" \
+	".8byte 0\n" \
+	".asciz \"psych\"\n" \
+	".asciz \"" #name "\"\n" \
+	".asciz \"" args "\"\n" \
+	"994:	.balign 4\n" \
+	".popsection\n" \
+	".ifndef _.stapsdt.base\n" \
+	".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	".weak _.stapsdt.base\n" \
+	".hidden _.stapsdt.base\n" \
+	"_.stapsdt.base: .space 1\n" \
+	".size _.stapsdt.base, 1\n" \
+	".popsection\n" \
+	".endif\n"
+
+#define PSYCH_PROBE2(name, a, b) \
+	__asm__ __volatile__(PSYCH_PROBE_NOTE(name, "-8@%[a0] -8@%[a1]") \
+		:: [a0] "nor" ((int64_t)(a)), [a1] "nor" ((int64_t)(b)))
+#define PSYCH_PROBE5(name, a, b, c, d, e) \
+	__asm__ __volatile__(PSYCH_PROBE_NOTE(name, "-8@%[a0] -8@%[a1] -8@%[a2] -8@%[a3] -8@%[a4]") \
+		:: [a0] "nor" ((int64_t)(a)), [a1] "nor" ((int64_t)(b)), [a2] "nor" ((int64_t)(c)), \
+		[a3] "nor" ((int64_t)(d)), [a4] "nor" ((int64_t)(e)))
+
+#else
+
+#define PSYCH_PROBE2(name, a, b) do { } while(0)
+#define PSYCH_PROBE5(name, a, b, c, d, e) do { } while(0)
+
+#endif
+
+
+#endif
@@ -4,15 +4,382 @@
  Author      : 
  Version     :
  Copyright   : Your copyright notice
- Description : Hello World in C, Ansi-style
+ Description : Psychrometric properties of BAS trend logs
  ============================================================================
  */
 
+#define PSYCH_METRICS		// wet_bulb() steps in the -S / -D metrics
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
 #include "psych.h"
+#include "trend.h"
+#include "pcache.h"
+#include "colfile.h"
+#include "mqingest.h"
+#include "modbus.h"
+#include "metrics_http.h"
 
-int main(void) {
-	printf("75DB 65WB %fRH", psych(14.7,75,65,1,3,0));
+static volatile sig_atomic_t stop = 0;
+static trend_reader reader;
+static vpd_window vpd;
+static mqtt_conn broker;
+static mqi_state ingest;
+static mb_poller poller;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void dump_metrics(void)
+{
+	metrics_write(stderr);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: psych [-S port] [-D] [-f | -c dir] [-o out.col] [-V lo:hi] [-P kPa] [-t col] [-r col] [-F] [-p] trend.csv\n"
+		"       psych -q name:lo:hi [-q ...] data.col\n"
+		"       psych -m host[:port] [-b n] [-P kPa] [-F] [-p] filter...\n"
+		"       psych -M [-i s] [-P kPa] host[:port]/unit/treg/rhreg...\n"
+		"  Appends W, h [kJ/kg] and dew point [C] to each row of a CSV trend log\n"
+		"  -f      follow the file as it grows (like tail -f)\n"
+		"  -c dir  reuse converted chunks cached in dir from earlier runs\n"
+		"  -o file store Tdb, RH, W, h, Tdp (SI) in a columnar file instead of CSV\n"
+		"  -V band append air VPD [kPa] and report its rolling mean over the last\n"
+		"          60 rows and the rows outside lo to hi kPa, e.g. -V 0.8:1.2\n"
+		"  -q spec print the rows of a columnar file with lo <= name <= hi,\n"
+		"          e.g. -q Tdp:12.8: for dew points of 12.8 C and above\n"
+		"  -m host subscribe to MQTT topic filters; readings on <point>/temp and\n"
+		"          <point>/rh are published back as JSON on <point>/psych\n"
+		"  -b n    points converted and published together, default 64\n"
+		"  -M      poll Modbus/TCP holding registers: dry bulb in tenths of a C\n"
+		"          at treg, RH in tenths of a percent at rhreg\n"
+		"  -i s    Modbus scan interval, default 10\n"
+		"  -S port serve Prometheus metrics on 127.0.0.1:port\n"
+		"  -D      write the metrics to stderr on exit\n"
+		"  -P kPa  barometric pressure, default 101.325\n"
+		"  -t col  dry bulb column, first column is 0, default 1\n"
+		"  -r col  RH column, default 2\n"
+		"  -F      dry bulb is in F (default C)\n"
+		"  -p      RH is in percent (default fraction)\n");
+}
+
+static int print_row(const col_file *r, int i, void *ctx)
+{
+	int c;
+	(void)ctx;
+	for(c = 0; c < r->ncols; c++)
+	{
+		printf(c ? ",%g" : "%g", r->buf[(size_t)c * COL_BLOCK + i]);
+	}
+	printf("\n");
+	return 0;
+}
+
+static int query(const char *path, char **spec, int nspec)
+{
+	col_pred pred[16];
+	col_file *r = col_open(path);
+	long hits;
+	int k, c;
+
+	if(!r)
+	{
+		fprintf(stderr, "%s: not a columnar file\n", path);
+		return EXIT_FAILURE;
+	}
+	for(k = 0; k < nspec; k++)
+	{
+		char *lo = strchr(spec[k], ':');
+		char *hi = lo ? strchr(lo + 1, ':') : NULL;
+		if(!hi)
+		{
+			usage();
+			col_close(r);
+			return EXIT_FAILURE;
+		}
+		*lo++ = 0;
+		*hi++ = 0;
+		pred[k].col = col_find(r, spec[k]);
+		pred[k].lo = *lo ? atof(lo) : -HUGE_VAL;
+		pred[k].hi = *hi ? atof(hi) : HUGE_VAL;
+		if(pred[k].col < 0)
+		{
+			fprintf(stderr, "%s: no column %s\n", path, spec[k]);
+			col_close(r);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for(c = 0; c < r->ncols; c++)
+	{
+		printf(c ? ",%s" : "%s", r->name[c]);
+	}
+	printf("\n");
+	hits = col_scan(r, pred, nspec, print_row, NULL);
+	fprintf(stderr, "%ld rows, %ld blocks read, %ld skipped\n", hits, r->blocks_read, r->blocks_skipped);
+	col_close(r);
+	return hits < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int subscribe(char *host, char **filter, int nfilter, double P, int fahrenheit, int percent, int batch)
+{
+	char *colon = strrchr(host, ':');
+	int port = MQTT_PORT, err;
+	char id[32];
+
+	if(colon)
+	{
+		*colon = 0;
+		port = atoi(colon + 1);
+	}
+	snprintf(id, sizeof(id), "psych-%ld", (long)getpid());
+	if(mqtt_connect(&broker, host, port, id, 30) != 0)
+	{
+		fprintf(stderr, "%s:%d: cannot connect to the broker\n", host, port);
+		return EXIT_FAILURE;
+	}
+	mqi_init(&ingest, &broker, P);
+	ingest.fahrenheit = fahrenheit;
+	ingest.percent = percent;
+	ingest.batch = batch < 1 ? 1 : batch > MQI_BATCH ? MQI_BATCH : batch;
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	err = mqi_run(&ingest, (const char *const *)filter, nfilter, &stop);
+	fprintf(stderr, "%ld readings, %ld rejected, %ld published, %d points\n",
+			ingest.readings, ingest.bad, ingest.published, ingest.n);
+	if(err)
+	{
+		fprintf(stderr, "%s:%d: connection lost\n", host, port);
+	}
+	mqtt_close(&broker);
+	mqi_free(&ingest);
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int modbus(char **spec, int nspec, double P, double interval)
+{
+	int k, n;
+
+	if(mb_init(&poller, P, 2000) != 0)
+	{
+		perror("epoll");
+		return EXIT_FAILURE;
+	}
+	for(k = 0; k < nspec; k++)
+	{
+		char host[256];
+		int port = MB_PORT, unit, treg, rhreg, dev;
+		char *colon;
+		if(sscanf(spec[k], "%255[^/]/%d/%d/%d", host, &unit, &treg, &rhreg) != 4)
+		{
+			usage();
+			mb_free(&poller);
+			return EXIT_FAILURE;
+		}
+		if((colon = strrchr(host, ':')) != NULL)
+		{
+			*colon = 0;
+			port = atoi(colon + 1);
+		}
+		if((dev = mb_add_device(&poller, host, port, unit, MB_HOLDING)) < 0
+				|| mb_add_sensor(&poller, dev, treg, 0.1, rhreg, 0.001) < 0)
+		{
+			fprintf(stderr, "%s: cannot add sensor\n", spec[k]);
+			mb_free(&poller);
+			return EXIT_FAILURE;
+		}
+	}
+	if(mb_plan(&poller) != 0)
+	{
+		fprintf(stderr, "too many register ranges on one device\n");
+		mb_free(&poller);
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	while(!stop)
+	{
+		double t = mb_now();
+		n = mb_scan(&poller);
+		for(k = 0; k < poller.nsensor; k++)
+		{
+			const mb_sensor *s = &poller.sensor[k];
+			if(s->ok)
+			{
+				printf("%s,%.1f,%.3f,%.6f,%.3f,%.2f\n", spec[k], s->Tdb, s->RH, s->W, s->h, s->Tdp);
+			}
+		}
+		fflush(stdout);
+		if(n < poller.nsensor)
+		{
+			fprintf(stderr, "%d of %d sensors did not answer\n", poller.nsensor - n, poller.nsensor);
+		}
+		t = interval - (mb_now() - t);
+		if(t > 0 && !stop)
+		{
+			struct timespec ts;
+			ts.tv_sec = (time_t)t;
+			ts.tv_nsec = (long)(1E9 * (t - ts.tv_sec));
+			nanosleep(&ts, NULL);
+		}
+	}
+	fprintf(stderr, "%d sensors on %d devices, %ld requests\n", poller.nsensor, poller.ndev, poller.requests);
+	mb_free(&poller);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+	int opt, follow = 0, fahrenheit = 0, percent = 0, tcol = 1, rhcol = 2;
+	double P = 101.325;
+	const char *cachedir = NULL, *colpath = NULL;
+	char *host = NULL;
+	int batch = 64, mb = 0, vpd_on = 0;
+	double vpd_lo = 0, vpd_hi = 0;
+	double interval = 10;
+	char *spec[16];
+	int nspec = 0;
+	pcache_stats st = {0, 0, 0};
+
+	if(argc < 2)
+	{
+		printf("75DB 65WB %fRH", psych(14.7,75,65,1,3,0));
+		return EXIT_SUCCESS;
+	}
+
+	while((opt = getopt(argc, argv, "fc:o:V:q:m:b:Mi:S:DP:t:r:Fp")) != -1)
+	{
+		switch(opt)
+		{
+		case 'f': follow = 1; break;
+		case 'c': cachedir = optarg; break;
+		case 'o': colpath = optarg; break;
+		case 'V':
+			if(sscanf(optarg, "%lf:%lf", &vpd_lo, &vpd_hi) != 2)
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+			vpd_on = 1;
+			break;
+		case 'm': host = optarg; break;
+		case 'b': batch = atoi(optarg); break;
+		case 'M': mb = 1; break;
+		case 'i': interval = atof(optarg); break;
+		case 'S':
+			if(metrics_serve("127.0.0.1", atoi(optarg)) != 0)
+			{
+				fprintf(stderr, "port %s: cannot serve metrics\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'D': atexit(dump_metrics); break;
+		case 'q':
+			if(nspec == 16)
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+			spec[nspec++] = optarg;
+			break;
+		case 'P': P = atof(optarg); break;
+		case 't': tcol = atoi(optarg); break;
+		case 'r': rhcol = atoi(optarg); break;
+		case 'F': fahrenheit = 1; break;
+		case 'p': percent = 1; break;
+		default: usage(); return EXIT_FAILURE;
+		}
+	}
+	if(mb)
+	{
+		if(optind == argc)
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		return modbus(argv + optind, argc - optind, P, interval);
+	}
+	if(host)
+	{
+		if(optind == argc)
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		return subscribe(host, argv + optind, argc - optind, P, fahrenheit, percent, batch);
+	}
+	// Cached chunks are not converted again, so they could not feed the VPD window
+	if(optind != argc - 1 || (follow && cachedir) || (colpath && cachedir) || (vpd_on && cachedir))
+	{
+		usage();
+		return EXIT_FAILURE;
+	}
+	if(nspec)
+	{
+		return query(argv[optind], spec, nspec);
+	}
+
+	if(trend_open(&reader, argv[optind], stdout, P) != 0)
+	{
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	reader.tcol = tcol;
+	reader.rhcol = rhcol;
+	reader.fahrenheit = fahrenheit;
+	reader.percent = percent;
+	if(vpd_on)
+	{
+		vpd_window_init(&vpd, vpd_lo, vpd_hi);
+		reader.vpd = &vpd;
+	}
+	if(colpath && !(reader.col = col_create(colpath, TREND_NCOLS, trend_col_names)))
+	{
+		perror(colpath);
+		return EXIT_FAILURE;
+	}
+
+	if(follow)
+	{
+		signal(SIGINT, on_signal);
+		signal(SIGTERM, on_signal);
+		trend_follow(&reader, &stop);
+	}
+	else if(cachedir)
+	{
+		if(pcache_run(&reader, argv[optind], cachedir, stdout, &st) != 0)
+		{
+			perror(cachedir);
+		}
+		fprintf(stderr, "%ld chunks, %ld cached, %ld converted\n", st.chunks, st.hits, st.misses);
+	}
+	else if(trend_poll(&reader) < 0)
+	{
+		perror(argv[optind]);
+	}
+	else
+	{
+		trend_finish(&reader);		// a last line without a newline
+	}
+	trend_close(&reader);
+	if(vpd_on)
+	{
+		fprintf(stderr, "VPD %.3f kPa mean, %.3f std over the last %d rows; %ld rows below %g, %ld above %g kPa\n",
+				vpd_window_mean(&vpd), vpd_window_std(&vpd), vpd.n, vpd.below, vpd_lo, vpd.above, vpd_hi);
+	}
+	if(reader.col && col_close(reader.col) != 0)
+	{
+		perror(colpath);
+		return EXIT_FAILURE;
+	}
 	return EXIT_SUCCESS;
 }
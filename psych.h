@@ -11,6 +11,14 @@
 #ifndef	PSYCH_H
 #define PSYCH_H
 #include <math.h>
+#ifdef PSYCH_METRICS
+#include "metrics.h"	// opt in: wet_bulb() records its Newton steps
+#endif
+#include "probes.h"
+
+#define PSYCH_WB_MAXITER 50	// Newton steps before wet_bulb() gives up
+// Define PSYCH_WB_COUNT as a counter variable before including psych.h and
+// wet_bulb() adds its Newton steps to it, e.g. for fuzz.c
 
 
 
@@ -137,23 +145,51 @@ double wet_bulb(double Tdb, double RH, double P)
  * Tdb = Dry bulb temperature [degC]
  * RH = Relative humidity ratio [Fraction or %]
  * P = Ambient Pressure [kPa]
+ * Returns NaN if it has not converged after PSYCH_WB_MAXITER steps
  */
 {
 	double W_normal = hum_rat2(Tdb, RH, P);
 
-	// Solve to within 0.001% accuracy using Newton-Rhapson
+	// Solve to within 0.001% accuracy using Newton-Rhapson; the 1E-9 kg/kg
+	// floor keeps bone dry air (W_normal = 0) from chasing an exact zero
 	double Wet_bulb = Tdb; // initialize at saturation
 	double W_new = hum_rat(Tdb, Wet_bulb, P);
+	double lo = -INFINITY, hi = INFINITY;	// wet bulbs known to be too low / too high
+	int iter = 0, unconverged;
 
 	do
 		{
+			iter++;
+			if(W_new > W_normal)
+			{
+				hi = Wet_bulb;
+			}
+			else
+			{
+				lo = Wet_bulb;
+			}
 			double W_new2 = hum_rat(Tdb, Wet_bulb - 0.001, P);
 			double dw_dtwb = (W_new - W_new2) / 0.001;
-			double Wet_bulb = Wet_bulb - (W_new - W_normal) / dw_dtwb;
+			Wet_bulb = Wet_bulb - (W_new - W_normal) / dw_dtwb;
+			// sat_press() steps between its ice and water curves at 0 C, where
+			// Newton can cycle; bisect the bracket instead of leaving it
+			if(isfinite(lo) && isfinite(hi) && !(Wet_bulb > lo && Wet_bulb < hi))
+			{
+				Wet_bulb = (lo + hi) / 2;
+			}
 			W_new = hum_rat(Tdb, Wet_bulb, P);
+			unconverged = fabs(W_new - W_normal) > 0.00001 * fabs(W_normal) + 1E-9 && hi - lo > 1E-6;
+			PSYCH_PROBE5(wet_bulb_iter, iter, psych_probe_int(1E3 * Tdb), psych_probe_int(1E6 * RH),
+					psych_probe_int(1E3 * Wet_bulb), psych_probe_int(1E9 * (W_new - W_normal)));
 		}
-		while (abs((W_new - W_normal) / W_normal) > 0.00001);
-	return Wet_bulb;
+		while (unconverged && iter < PSYCH_WB_MAXITER);
+#ifdef PSYCH_WB_COUNT
+	PSYCH_WB_COUNT += iter;
+#endif
+#ifdef PSYCH_METRICS
+	metric_observe(METRIC_WETBULB_ITERS, iter);
+#endif
+	return unconverged ? NAN : Wet_bulb;
 
 }
 
@@ -251,7 +287,7 @@ double STD_temp(double elevation)
 	return 15 - 0.0065 * elevation;
 }
 
-double psych(double P, double Tdb, int inValue, int inType, int outType, int SIq)
+double psych(double P, double Tdb, double inValue, int inType, int outType, int SIq)
 {
 /*
  * P is the barometric pressure in PSI or Pa.
@@ -277,7 +313,7 @@ double psych(double P, double Tdb, int inValue, int inType, int outType, int SIq
  * 10 Moist Air Density       lb/ft^3 or m^3/kg
  */
 
-	double Twb, Dew, RH, W, h, out;
+	double Twb = NAN, Dew = NAN, RH = NAN, W = NAN, h = NAN, out = NAN;	// NaN for an invalid inType or outType
 
 	if(SIq == 1)
 	{
@@ -372,6 +408,7 @@ double psych(double P, double Tdb, int inValue, int inType, int outType, int SIq
 	        break;
 	    case 4:									// Given W
 	        // W already known
+	        break;
 	    case 7:									// Given h
 	        W = (1.006 * Tdb - h) / (-(2501 + 1.86 * Tdb));
 	        // Algebra from 2005 ASHRAE Handbook - Fundamentals - SI P6.9 eqn 32
@@ -0,0 +1,271 @@
+/*
+ * psych_batch.h
+ *
+ * Array versions of the psych.h state functions.
+ *
+ * Each kernel evaluates the same equation as its scalar counterpart over
+ * n elements.  The loops are branch free and restrict qualified so the
+ * compiler can vectorize them; build with -O3 -ffast-math (or -fopenmp-simd)
+ * to let gcc call the vector exp/log of glibc's libmvec.
+ * Units are SI as in psych.h.
+ *
+ */
+
+#ifndef PSYCH_BATCH_H
+#define PSYCH_BATCH_H
+#include <math.h>
+#include "psych.h"
+#include "probes.h"
+
+
+void part_press_batch(double P, const double *restrict W, double *restrict Pw, int n)
+/*
+ * Partial vapor pressure [kPa] of n humidity ratios at pressure P [kPa],
+ * as part_press()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "part_press_batch", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		Pw[i] = P * W[i] / (0.62198 + W[i]);
+	}
+	PSYCH_PROBE2(batch_exit, "part_press_batch", n);
+}
+
+
+#pragma omp declare simd
+double sat_press_bf(double Tdb)
+/*
+ * Branch free sat_press() used by the batch kernels
+ * The ice and water coefficient sets are selected by value, so a single
+ * exp and log are evaluated and the loops calling it stay vectorizable.
+ */
+{
+	double TK = Tdb + 273.15;
+	int ice = TK <= 273.15;
+	double a = ice ? -5674.5359 : -5800.2206;
+	double b = ice ? 6.3925247 : 1.3914993;
+	double c = ice ? -0.009677843 : -0.048640239;
+	double d = ice ? 0.00000062215701 : 0.000041764768;
+	double e = ice ? 2.0747825E-09 : -0.000000014452093;
+	double f = ice ? -9.484024E-13 : 0;
+	double g = ice ? 4.1635019 : 6.5459673;
+	return exp(a / TK + b + TK * (c + TK * (d + TK * (e + TK * f))) + g * log(TK)) / 1000;
+}
+
+
+#pragma omp declare simd
+double dew_point_bf(double P, double W)
+/*
+ * Branch free dew_point() used by the batch kernels
+ */
+{
+	double Pw = P * W / (0.62198 + W);
+	double alpha = log(Pw);
+	double Tdp1 = 6.54 + alpha * (14.526 + alpha * (0.7389 + alpha * 0.09486)) + 0.4569 * exp(0.1984 * alpha);
+	double Tdp2 = 6.09 + alpha * (12.608 + alpha * 0.4959);
+	return Tdp1 >= 0 ? Tdp1 : Tdp2;
+}
+
+
+void sat_press_batch(const double *restrict Tdb, double *restrict Pws, int n)
+/*
+ * Saturation vapor pressure [kPa] of n dry bulb temperatures [degC],
+ * as sat_press()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "sat_press_batch", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		Pws[i] = sat_press_bf(Tdb[i]);
+	}
+	PSYCH_PROBE2(batch_exit, "sat_press_batch", n);
+}
+
+
+void hum_rat2_batch(const double *restrict Tdb, const double *restrict RH, double P,
+		double *restrict W, int n)
+/*
+ * Humidity ratio [kg H2O/kg air] from n dry bulb [degC] and RH [Fraction]
+ * pairs at a common pressure P [kPa], as hum_rat2()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "hum_rat2_batch", n);
+	sat_press_batch(Tdb, W, n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		double Pw = RH[i] * W[i];
+		W[i] = 0.62198 * Pw / (P - Pw);
+	}
+	PSYCH_PROBE2(batch_exit, "hum_rat2_batch", n);
+}
+
+
+void enthalpy_air_h2o_batch(const double *restrict Tdb, const double *restrict W,
+		double *restrict h, int n)
+/*
+ * Enthalpy [kJ/kg dry air] of n states, as enthalpy_air_h2o()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "enthalpy_air_h2o_batch", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		h[i] = 1.006 * Tdb[i] + W[i] * (2501 + 1.86 * Tdb[i]);
+	}
+	PSYCH_PROBE2(batch_exit, "enthalpy_air_h2o_batch", n);
+}
+
+
+void dew_point_batch(double P, const double *restrict W, double *restrict Tdp, int n)
+/*
+ * Dew point [degC] of n humidity ratios at pressure P [kPa], as dew_point()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "dew_point_batch", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		Tdp[i] = dew_point_bf(P, W[i]);
+	}
+	PSYCH_PROBE2(batch_exit, "dew_point_batch", n);
+}
+
+
+void dry_air_density_batch(double P, const double *restrict Tdb, const double *restrict W,
+		double *restrict rho, int n)
+/*
+ * Dry air density [kg_dry_air/m^3] of n states at pressure P [kPa],
+ * as dry_air_density()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "dry_air_density_batch", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		rho[i] = 1000 * P / (287.055 * (273.15 + Tdb[i]) * (1 + 1.6078 * W[i]));
+	}
+	PSYCH_PROBE2(batch_exit, "dry_air_density_batch", n);
+}
+
+
+/*
+ * Strided kernels for arrays of records
+ * They read and write the fields in place, e.g. for struct rec r[n]
+ *   hum_rat2_strided(&r[0].Tdb, s, &r[0].RH, s, &r[0].P, s, &r[0].W, s, n)
+ * with s = sizeof(r[0]) / sizeof(double), so no copy into columns is
+ * needed.  Strides count doubles: 1 is a plain column, 0 repeats a single
+ * value such as a shared pressure.  The loops vectorize with gathers where
+ * the target has them.
+ */
+
+
+void sat_press_strided(const double *restrict Tdb, int ts, double *restrict Pws, int ps, int n)
+/*
+ * Saturation vapor pressure [kPa] of n dry bulb temperatures [degC]
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "sat_press_strided", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		Pws[(long)i * ps] = sat_press_bf(Tdb[(long)i * ts]);
+	}
+	PSYCH_PROBE2(batch_exit, "sat_press_strided", n);
+}
+
+
+void hum_rat2_strided(const double *restrict Tdb, int ts, const double *restrict RH, int rs,
+		const double *restrict P, int pstride, double *restrict W, int ws, int n)
+/*
+ * Humidity ratio [kg H2O/kg air] of n dry bulb [degC], RH [Fraction] and
+ * pressure [kPa] triples, as hum_rat2()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "hum_rat2_strided", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		double Pw = RH[(long)i * rs] * sat_press_bf(Tdb[(long)i * ts]);
+		W[(long)i * ws] = 0.62198 * Pw / (P[(long)i * pstride] - Pw);
+	}
+	PSYCH_PROBE2(batch_exit, "hum_rat2_strided", n);
+}
+
+
+void enthalpy_air_h2o_strided(const double *restrict Tdb, int ts, const double *restrict W, int wstride,
+		double *restrict h, int hs, int n)
+/*
+ * Enthalpy [kJ/kg dry air] of n states, as enthalpy_air_h2o()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "enthalpy_air_h2o_strided", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		double T = Tdb[(long)i * ts];
+		h[(long)i * hs] = 1.006 * T + W[(long)i * wstride] * (2501 + 1.86 * T);
+	}
+	PSYCH_PROBE2(batch_exit, "enthalpy_air_h2o_strided", n);
+}
+
+
+void dew_point_strided(const double *restrict P, int pstride, const double *restrict W, int wstride,
+		double *restrict Tdp, int ds, int n)
+/*
+ * Dew point [degC] of n humidity ratio and pressure pairs, as dew_point()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "dew_point_strided", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		Tdp[(long)i * ds] = dew_point_bf(P[(long)i * pstride], W[(long)i * wstride]);
+	}
+	PSYCH_PROBE2(batch_exit, "dew_point_strided", n);
+}
+
+
+void dry_air_density_strided(const double *restrict P, int pstride, const double *restrict Tdb, int ts,
+		const double *restrict W, int wstride, double *restrict rho, int rs, int n)
+/*
+ * Dry air density [kg_dry_air/m^3] of n states, as dry_air_density()
+ */
+{
+	int i;
+
+	PSYCH_PROBE2(batch_entry, "dry_air_density_strided", n);
+	#pragma omp simd
+	for(i = 0; i < n; i++)
+	{
+		rho[(long)i * rs] = 1000 * P[(long)i * pstride]
+				/ (287.055 * (273.15 + Tdb[(long)i * ts]) * (1 + 1.6078 * W[(long)i * wstride]));
+	}
+	PSYCH_PROBE2(batch_exit, "dry_air_density_strided", n);
+}
+
+
+#endif
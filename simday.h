@@ -0,0 +1,342 @@
+/*
+ * simday.h
+ *
+ * Similar day index for M&V baselines.
+ *
+ * Each weather day is reduced to a short psychrometric feature vector
+ * (enthalpy and dew point profile) and the days are stored in a kd-tree,
+ * so the k most similar baseline days for a reporting day are found in
+ * about log(N) distance evaluations instead of comparing every pair.
+ *
+ */
+
+#ifndef SIMDAY_H
+#define SIMDAY_H
+#include <stdlib.h>
+#include <math.h>
+#include "psych.h"
+
+#define SIMDAY_HOURS 24
+#define SIMDAY_DIM 6		// features produced by simday_features()
+#define SIMDAY_MAXDIM 16	// largest feature vector the tree accepts
+
+
+typedef struct
+{
+	int n;				// number of days indexed
+	int dim;			// length of each feature vector
+	double *pts;		// n * dim scaled features, in tree order
+	int *day;			// caller's day number for each tree slot
+	int *axis;			// split axis of the node stored at each slot
+	double scale[SIMDAY_MAXDIM];	// 1 / standard deviation of each feature
+} simday_tree;
+
+
+void simday_features(const double *Tdb, const double *RH, double P, double *feat)
+/*
+ * Computes the SIMDAY_DIM features of one day from hourly weather
+ * Tdb = 24 hourly dry bulb temperatures [degC]
+ * RH = 24 hourly relative humidities [Fraction]
+ * P = Ambient pressure [kPa]
+ * feat = output: mean, min and max enthalpy [kJ/kg dry air],
+ *        then mean, min and max dew point [degC]
+ */
+{
+	int i;
+	double h, Tdp, W;
+	double hsum = 0, hmin = HUGE_VAL, hmax = -HUGE_VAL;
+	double dsum = 0, dmin = HUGE_VAL, dmax = -HUGE_VAL;
+
+	for(i = 0; i < SIMDAY_HOURS; i++)
+	{
+		W = hum_rat2(Tdb[i], RH[i], P);
+		h = enthalpy_air_h2o(Tdb[i], W);
+		Tdp = dew_point(P, W);
+		hsum += h;
+		hmin = fmin(hmin, h);
+		hmax = fmax(hmax, h);
+		dsum += Tdp;
+		dmin = fmin(dmin, Tdp);
+		dmax = fmax(dmax, Tdp);
+	}
+	feat[0] = hsum / SIMDAY_HOURS;
+	feat[1] = hmin;
+	feat[2] = hmax;
+	feat[3] = dsum / SIMDAY_HOURS;
+	feat[4] = dmin;
+	feat[5] = dmax;
+}
+
+
+void simday_swap(simday_tree *t, int a, int b)
+/*
+ * Swaps two slots of the tree during the build
+ */
+{
+	int j, d = t->dim;
+	double tmp;
+	int ti = t->day[a];
+	t->day[a] = t->day[b];
+	t->day[b] = ti;
+	for(j = 0; j < d; j++)
+	{
+		tmp = t->pts[a * d + j];
+		t->pts[a * d + j] = t->pts[b * d + j];
+		t->pts[b * d + j] = tmp;
+	}
+}
+
+
+void simday_select(simday_tree *t, int lo, int hi, int k, int ax)
+/*
+ * Quickselect: partially orders slots lo to hi-1 on axis ax so that slot k
+ * holds the median and lower / higher values are on either side
+ */
+{
+	int d = t->dim;
+	while(hi - lo > 1)
+	{
+		int i, store = lo;
+		double pivot;
+		simday_swap(t, (lo + hi) / 2, hi - 1);
+		pivot = t->pts[(hi - 1) * d + ax];
+		for(i = lo; i < hi - 1; i++)
+		{
+			if(t->pts[i * d + ax] < pivot)
+			{
+				simday_swap(t, i, store++);
+			}
+		}
+		simday_swap(t, store, hi - 1);
+		if(store == k)
+		{
+			return;
+		}
+		else if(store < k)
+		{
+			lo = store + 1;
+		}
+		else
+		{
+			hi = store;
+		}
+	}
+}
+
+
+void simday_split(simday_tree *t, int lo, int hi)
+/*
+ * Builds the subtree over slots lo to hi-1, splitting on the widest axis
+ */
+{
+	int i, j, mid, ax = 0, d = t->dim;
+	double spread = -1;
+
+	if(hi - lo < 1)
+	{
+		return;
+	}
+	for(j = 0; j < d; j++)
+	{
+		double a = HUGE_VAL, b = -HUGE_VAL;
+		for(i = lo; i < hi; i++)
+		{
+			a = fmin(a, t->pts[i * d + j]);
+			b = fmax(b, t->pts[i * d + j]);
+		}
+		if(b - a > spread)
+		{
+			spread = b - a;
+			ax = j;
+		}
+	}
+	mid = (lo + hi) / 2;
+	simday_select(t, lo, hi, mid, ax);
+	t->axis[mid] = ax;
+	simday_split(t, lo, mid);
+	simday_split(t, mid + 1, hi);
+}
+
+
+int simday_build(simday_tree *t, const double *feat, int n, int dim)
+/*
+ * Builds the index over n days
+ * feat = n * dim features, day i at feat[i * dim]
+ * Features are scaled to unit variance so enthalpy and dew point carry
+ * equal weight in the distance.
+ * Returns 0 on success, -1 on bad arguments or out of memory
+ */
+{
+	int i, j;
+
+	t->n = 0;
+	t->pts = NULL;
+	t->day = NULL;
+	t->axis = NULL;
+	if(n < 1 || dim < 1 || dim > SIMDAY_MAXDIM)
+	{
+		return -1;
+	}
+
+	t->pts = malloc(sizeof(double) * n * dim);
+	t->day = malloc(sizeof(int) * n);
+	t->axis = malloc(sizeof(int) * n);
+	if(!t->pts || !t->day || !t->axis)
+	{
+		free(t->pts);
+		free(t->day);
+		free(t->axis);
+		t->pts = NULL;
+		t->day = NULL;
+		t->axis = NULL;
+		return -1;
+	}
+	t->n = n;
+	t->dim = dim;
+
+	for(j = 0; j < dim; j++)
+	{
+		double mean = 0, var = 0;
+		for(i = 0; i < n; i++)
+		{
+			mean += feat[i * dim + j];
+		}
+		mean /= n;
+		for(i = 0; i < n; i++)
+		{
+			var += (feat[i * dim + j] - mean) * (feat[i * dim + j] - mean);
+		}
+		var /= n;
+		t->scale[j] = var > 0 ? 1 / sqrt(var) : 1;
+	}
+	for(i = 0; i < n; i++)
+	{
+		t->day[i] = i;
+		for(j = 0; j < dim; j++)
+		{
+			t->pts[i * dim + j] = feat[i * dim + j] * t->scale[j];
+		}
+	}
+
+	simday_split(t, 0, n);
+	return 0;
+}
+
+
+void simday_search(const simday_tree *t, int lo, int hi, const double *q, int k,
+		int *best, double *dist, int *found)
+/*
+ * Recursive k nearest neighbour search over slots lo to hi-1
+ * best / dist hold the current neighbours sorted by increasing distance
+ */
+{
+	int j, mid, d = t->dim;
+	double dd = 0, diff;
+
+	if(hi - lo < 1)
+	{
+		return;
+	}
+	mid = (lo + hi) / 2;
+	for(j = 0; j < d; j++)
+	{
+		diff = t->pts[mid * d + j] - q[j];
+		dd += diff * diff;
+	}
+	if(*found < k || dd < dist[*found - 1])
+	{
+		// Insertion into the sorted neighbour list
+		int pos = *found < k ? (*found)++ : k - 1;
+		while(pos > 0 && dist[pos - 1] > dd)
+		{
+			dist[pos] = dist[pos - 1];
+			best[pos] = best[pos - 1];
+			pos--;
+		}
+		dist[pos] = dd;
+		best[pos] = t->day[mid];
+	}
+
+	diff = q[t->axis[mid]] - t->pts[mid * d + t->axis[mid]];
+	if(diff < 0)
+	{
+		simday_search(t, lo, mid, q, k, best, dist, found);
+		if(*found < k || diff * diff < dist[*found - 1])
+		{
+			simday_search(t, mid + 1, hi, q, k, best, dist, found);
+		}
+	}
+	else
+	{
+		simday_search(t, mid + 1, hi, q, k, best, dist, found);
+		if(*found < k || diff * diff < dist[*found - 1])
+		{
+			simday_search(t, lo, mid, q, k, best, dist, found);
+		}
+	}
+}
+
+
+int simday_knn(const simday_tree *t, const double *feat, int k, int *day, double *dist)
+/*
+ * Finds the k baseline days most similar to a reporting day
+ * feat = features of the reporting day (unscaled, same layout as the build)
+ * day = output: day numbers of the neighbours, nearest first
+ * dist = output: scaled euclidean distances, may be NULL
+ * Returns the number of neighbours found (less than k if the index is small)
+ */
+{
+	int j, found = 0;
+	double q[SIMDAY_MAXDIM];
+	double d2[64];
+	double *dd = d2;
+
+	if(k < 1 || t->n < 1)
+	{
+		return 0;
+	}
+	if(k > 64)
+	{
+		dd = malloc(sizeof(double) * k);
+		if(!dd)
+		{
+			return 0;
+		}
+	}
+	for(j = 0; j < t->dim; j++)
+	{
+		q[j] = feat[j] * t->scale[j];
+	}
+
+	simday_search(t, 0, t->n, q, k, day, dd, &found);
+	if(dist)
+	{
+		for(j = 0; j < found; j++)
+		{
+			dist[j] = sqrt(dd[j]);
+		}
+	}
+	if(dd != d2)
+	{
+		free(dd);
+	}
+	return found;
+}
+
+
+void simday_free(simday_tree *t)
+/*
+ * Releases the memory held by the index
+ */
+{
+	free(t->pts);
+	free(t->day);
+	free(t->axis);
+	t->pts = NULL;
+	t->day = NULL;
+	t->axis = NULL;
+	t->n = 0;
+}
+
+
+#endif
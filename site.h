@@ -0,0 +1,113 @@
+/*
+ * site.h
+ *
+ * Elevation cache for site pressure and temperature.
+ *
+ * Buildings in a portfolio sit at a limited number of elevations, but the
+ * per-point functions would evaluate STD_press() (a pow) for every box and
+ * every time step.  site_lookup() computes the standard atmosphere once per
+ * elevation and serves later calls from a small open addressing table.
+ *
+ */
+
+#ifndef SITE_H
+#define SITE_H
+#include <math.h>
+#include "psych.h"
+
+#define SITE_SLOTS 256		// table size, a power of two larger than the number of sites
+
+
+typedef struct
+{
+	double elevation;	// height relative to sea level [m]
+	double P;			// STD_press(elevation) [kPa]
+	double Tstd;		// STD_temp(elevation) [degC]
+} site;
+
+
+typedef struct
+{
+	long key[SITE_SLOTS];	// cm above -5000 m, or -1 for an empty slot
+	site entry[SITE_SLOTS];
+	site spare;				// returned once the table is full
+	int used;
+	long hits;
+	long misses;
+} site_cache;
+
+
+void site_cache_init(site_cache *c)
+/*
+ * Empties the cache
+ */
+{
+	int i;
+	for(i = 0; i < SITE_SLOTS; i++)
+	{
+		c->key[i] = -1;
+	}
+	c->used = 0;
+	c->hits = 0;
+	c->misses = 0;
+}
+
+
+void site_set(site *s, double elevation)
+/*
+ * Computes the standard atmosphere at an elevation [m]
+ */
+{
+	s->elevation = elevation;
+	s->P = STD_press(elevation);
+	s->Tstd = STD_temp(elevation);
+}
+
+
+const site *site_lookup(site_cache *c, double elevation)
+/*
+ * Returns the site at an elevation [m], resolved to the nearest cm
+ * Valid from -5000m to 11000m as STD_press().  When the table is full
+ * the entry is computed into a spare slot and not kept, so the pointer
+ * is only valid until the next lookup.
+ */
+{
+	long key = lround(elevation * 100) + 500000;	// non negative over the valid range
+	unsigned long slot = ((unsigned long)key * 2654435761UL) & (SITE_SLOTS - 1);
+	int probe;
+
+	if(key < 0)
+	{
+		c->misses++;
+		site_set(&c->spare, elevation);
+		return &c->spare;
+	}
+	for(probe = 0; probe < SITE_SLOTS; probe++)
+	{
+		if(c->key[slot] == key)
+		{
+			c->hits++;
+			return &c->entry[slot];
+		}
+		if(c->key[slot] < 0)
+		{
+			break;
+		}
+		slot = (slot + 1) & (SITE_SLOTS - 1);
+	}
+
+	c->misses++;
+	if(c->used >= SITE_SLOTS * 3 / 4)
+	{
+		// Keep the load factor bounded so probe sequences stay short
+		site_set(&c->spare, key / 100.0 - 5000);
+		return &c->spare;
+	}
+	c->key[slot] = key;
+	c->used++;
+	site_set(&c->entry[slot], key / 100.0 - 5000);
+	return &c->entry[slot];
+}
+
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * stack.h
+ *
+ * Stack effect pressure profile for high-rise buildings.
+ *
+ * Indoor and outdoor air density are evaluated at every floor with
+ * dry_air_density(), the outdoor pressure and temperature lapse coming from
+ * STD_press() and STD_temp().  The hydrostatic pressure difference is
+ * integrated up the building and the ground floor offset is solved so the
+ * leakage flows balance (equal leakage per floor, flow ~ dp^n), which
+ * places the neutral plane.  Per floor pressures and the temperature lapse
+ * are cached in the building so an hourly run only evaluates densities.
+ * stack_hourly() solves STACK_CHUNK hours side by side, so the density and
+ * leakage loops run across hours and vectorize.
+ *
+ */
+
+#ifndef STACK_H
+#define STACK_H
+#include <stddef.h>
+#include <math.h>
+#include "psych.h"
+#include "psych_batch.h"
+
+#define STACK_MAXFLOORS 200
+#define STACK_G 9.80665			// gravity [m/s^2]
+#define STACK_SOLVE_ITER 50		// bisection steps for the ground floor offset
+#define STACK_CHUNK 32			// hours solved together by stack_chunk()
+
+
+typedef struct
+{
+	int nf;							// number of floors
+	double floor_h;					// floor to floor height [m]
+	double elevation;				// ground elevation above sea level [m]
+	double leak_n;					// leakage flow exponent, 0.65 typical
+	double P[STACK_MAXFLOORS];		// cached standard pressure at each floor mid height [kPa]
+	double lapse[STACK_MAXFLOORS];	// cached outdoor temperature change from the ground [degC]
+} stack_bldg;
+
+
+int stack_init(stack_bldg *b, int nf, double floor_h, double elevation, double leak_n)
+/*
+ * Sets up a building and caches its per floor atmosphere
+ * Returns 0 on success, -1 if nf is out of range
+ */
+{
+	int k;
+	double z;
+
+	if(nf < 1 || nf > STACK_MAXFLOORS)
+	{
+		return -1;
+	}
+	b->nf = nf;
+	b->floor_h = floor_h;
+	b->elevation = elevation;
+	b->leak_n = leak_n;
+	for(k = 0; k < nf; k++)
+	{
+		z = (k + 0.5) * floor_h;
+		b->P[k] = STD_press(elevation + z);
+		b->lapse[k] = STD_temp(elevation + z) - STD_temp(elevation);
+	}
+	return 0;
+}
+
+
+double stack_leak_sum(const double *a, int nf, double dp0, double n)
+/*
+ * Net leakage flow (arbitrary units) for a ground floor offset dp0 [Pa]
+ */
+{
+	int k;
+	double sum = 0;
+	for(k = 0; k < nf; k++)
+	{
+		double d = dp0 - a[k];
+		sum += d >= 0 ? pow(d, n) : -pow(-d, n);
+	}
+	return sum;
+}
+
+
+double stack_plane(const stack_bldg *b, const double *a, int as, double dp0, double *dp)
+/*
+ * Floor pressures and neutral plane of a solved hour
+ * a = hydrostatic integral at each floor [Pa], floor k at a[k * as]
+ * dp0 = ground floor offset [Pa]
+ * dp = output, outdoor minus indoor pressure at each floor [Pa]; may be NULL
+ * Returns the neutral plane height above ground [m], NaN without one
+ */
+{
+	int k, found = 0;		// a flag rather than isnan(zn), which -ffast-math folds away
+	double zn = NAN;
+	for(k = 0; k < b->nf; k++)
+	{
+		double d = dp0 - a[(size_t)k * as];
+		if(dp)
+		{
+			dp[k] = d;
+		}
+		if(k > 0 && !found && (d >= 0) != (dp0 - a[(size_t)(k - 1) * as] >= 0))
+		{
+			// Linear interpolation between the floors bracketing the sign change
+			double d1 = dp0 - a[(size_t)(k - 1) * as];
+			zn = (k - 0.5 + d1 / (d1 - d)) * b->floor_h;
+			found = 1;
+		}
+	}
+	return zn;
+}
+
+
+double stack_profile(const stack_bldg *b, double Tout, double Wout, double Tin, double Win, double *dp)
+/*
+ * Computes the stack pressure profile for one hour
+ * Tout, Wout = outdoor dry bulb [degC] and humidity ratio at ground level
+ * Tin, Win = indoor dry bulb [degC] and humidity ratio, uniform with height
+ * dp = output, outdoor minus indoor pressure at each floor [Pa], positive
+ *      means infiltration; may be NULL
+ * Returns the neutral plane height above ground [m], or NaN when indoor
+ * and outdoor densities are equal and there is no stack effect
+ */
+{
+	int k;
+	double a[STACK_MAXFLOORS];
+	double sum = 0, lo, hi, dp0;
+
+	// a[k] = g * integral of (rho_out - rho_in) from the ground to floor k
+	for(k = 0; k < b->nf; k++)
+	{
+		double ro = dry_air_density(b->P[k], Tout + b->lapse[k], Wout) * (1 + Wout);
+		double ri = dry_air_density(b->P[k], Tin, Win) * (1 + Win);
+		double dz = k == 0 ? b->floor_h / 2 : b->floor_h;
+		sum += STACK_G * (ro - ri) * dz;
+		a[k] = sum;
+	}
+
+	lo = fmin(a[0], a[b->nf - 1]);
+	hi = fmax(a[0], a[b->nf - 1]);
+	for(k = 0; k < STACK_SOLVE_ITER; k++)
+	{
+		dp0 = (lo + hi) / 2;
+		if(stack_leak_sum(a, b->nf, dp0, b->leak_n) > 0)
+		{
+			hi = dp0;
+		}
+		else
+		{
+			lo = dp0;
+		}
+	}
+	return stack_plane(b, a, 1, (lo + hi) / 2, dp);
+}
+
+
+void stack_chunk(const stack_bldg *b, const double *Tout, const double *Wout, double Tin, double Win,
+		int m, double *npl, double *dp)
+/*
+ * stack_profile() for 1 <= m <= STACK_CHUNK hours at once
+ * The floors are walked in the outer loops and the hours in the inner
+ * ones, so the densities go through dry_air_density_batch() and every
+ * bisection step evaluates the leakage of all hours as one vector loop.
+ * A short chunk repeats its last hour, keeping every loop STACK_CHUNK
+ * long for the vectorizer.
+ * dp = output m * nf floor pressure differences [Pa]; may be NULL
+ */
+{
+	int i, k, it;
+	double a[STACK_MAXFLOORS][STACK_CHUNK];		// hydrostatic integral, floor k of hour i at a[k][i]
+	double To[STACK_CHUNK], Wo[STACK_CHUNK], Tk[STACK_CHUNK], ro[STACK_CHUNK];
+	double sum[STACK_CHUNK], lo[STACK_CHUNK], hi[STACK_CHUNK];
+	double n = b->leak_n;
+
+	for(i = 0; i < STACK_CHUNK; i++)
+	{
+		To[i] = Tout[i < m ? i : m - 1];
+		Wo[i] = Wout[i < m ? i : m - 1];
+		sum[i] = 0;
+	}
+	for(k = 0; k < b->nf; k++)
+	{
+		double ri = dry_air_density(b->P[k], Tin, Win) * (1 + Win);
+		double dz = k == 0 ? b->floor_h / 2 : b->floor_h;
+		for(i = 0; i < STACK_CHUNK; i++)
+		{
+			Tk[i] = To[i] + b->lapse[k];
+		}
+		dry_air_density_batch(b->P[k], Tk, Wo, ro, STACK_CHUNK);
+		#pragma omp simd
+		for(i = 0; i < STACK_CHUNK; i++)
+		{
+			sum[i] += STACK_G * (ro[i] * (1 + Wo[i]) - ri) * dz;
+			a[k][i] = sum[i];
+		}
+	}
+
+	for(i = 0; i < STACK_CHUNK; i++)
+	{
+		lo[i] = fmin(a[0][i], a[b->nf - 1][i]);
+		hi[i] = fmax(a[0][i], a[b->nf - 1][i]);
+	}
+	for(it = 0; it < STACK_SOLVE_ITER; it++)
+	{
+		for(i = 0; i < STACK_CHUNK; i++)
+		{
+			sum[i] = 0;
+		}
+		for(k = 0; k < b->nf; k++)
+		{
+			#pragma omp simd
+			for(i = 0; i < STACK_CHUNK; i++)
+			{
+				double d = (lo[i] + hi[i]) / 2 - a[k][i];
+				sum[i] += copysign(pow(fabs(d), n), d);
+			}
+		}
+		#pragma omp simd
+		for(i = 0; i < STACK_CHUNK; i++)
+		{
+			double dp0 = (lo[i] + hi[i]) / 2;
+			hi[i] = sum[i] > 0 ? dp0 : hi[i];
+			lo[i] = sum[i] > 0 ? lo[i] : dp0;
+		}
+	}
+
+	for(i = 0; i < m; i++)
+	{
+		npl[i] = stack_plane(b, &a[0][i], STACK_CHUNK, (lo[i] + hi[i]) / 2, dp ? dp + (size_t)i * b->nf : NULL);
+	}
+}
+
+
+void stack_hourly(const stack_bldg *b, const double *Tout, const double *Wout, double Tin, double Win,
+		int nh, double *npl, double *dp)
+/*
+ * Runs stack_profile() for nh hours of one building, STACK_CHUNK hours
+ * per stack_chunk() call
+ * npl = output nh neutral plane heights [m]
+ * dp = output nh * nf floor pressure differences [Pa], hour i at i * nf; may be NULL
+ */
+{
+	int i;
+	#pragma omp parallel for schedule(static)
+	for(i = 0; i < nh; i += STACK_CHUNK)
+	{
+		int m = nh - i < STACK_CHUNK ? nh - i : STACK_CHUNK;
+		stack_chunk(b, Tout + i, Wout + i, Tin, Win, m, npl + i, dp ? dp + (size_t)i * b->nf : NULL);
+	}
+}
+
+
+void stack_buildings(const stack_bldg *b, int nb, const double *Tout, const double *Wout,
+		const double *Tin, const double *Win, int nh, double *npl)
+/*
+ * Neutral plane heights for nb buildings sharing one weather file
+ * Tin, Win = nb indoor conditions
+ * npl = output nb * nh heights [m], building j at j * nh
+ */
+{
+	int j, i;
+	#pragma omp parallel for collapse(2) schedule(static)
+	for(j = 0; j < nb; j++)
+	{
+		for(i = 0; i < nh; i += STACK_CHUNK)
+		{
+			int m = nh - i < STACK_CHUNK ? nh - i : STACK_CHUNK;
+			stack_chunk(&b[j], Tout + i, Wout + i, Tin[j], Win[j], m, npl + (size_t)j * nh + i, NULL);
+		}
+	}
+}
+
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * sweep.h
+ *
+ * Parametric sweep engine for equipment selection studies.
+ *
+ * A sweep_grid lists the values of each design parameter; every
+ * combination is run against every weather hour by a model function and
+ * the hourly outputs are reduced to an annual sum and a peak per
+ * combination.  Outdoor states are computed once per hour before the
+ * sweep and shared by all combinations.  Combinations are evaluated in
+ * chunks with OpenMP dynamic scheduling, so idle threads pick up the
+ * remaining work, and each finished chunk is streamed to a colfile.h
+ * result file in combination order.
+ *
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "psych.h"
+#include "psych_batch.h"
+#include "colfile.h"
+
+#define SWEEP_MAXP 16		// parameters in a grid
+#define SWEEP_MAXOUT 16		// outputs of a model
+#define SWEEP_CHUNK 1024	// combinations evaluated between writes
+
+
+typedef struct
+{
+	double Tdb;		// outdoor dry bulb [degC]
+	double RH;		// outdoor relative humidity [Fraction]
+	double W;		// outdoor humidity ratio [kg/kg dry air]
+	double h;		// outdoor enthalpy [kJ/kg dry air]
+	double Tdp;		// outdoor dew point [degC]
+} sweep_hour;
+
+
+typedef struct
+{
+	int np;							// number of parameters
+	const char *name[SWEEP_MAXP];	// column name of each parameter
+	const double *val[SWEEP_MAXP];	// values of each parameter
+	int nval[SWEEP_MAXP];			// number of values of each parameter
+} sweep_grid;
+
+
+/*
+ * A model evaluates one combination for one hour
+ * param = np parameter values
+ * oa = shared outdoor state of the hour
+ * out = nout outputs for the hour
+ * ctx = caller data, read only during the sweep
+ */
+typedef void (*sweep_model)(const double *param, const sweep_hour *oa, double *out, void *ctx);
+
+
+void sweep_hours(const double *Tdb, const double *RH, double P, int nh, sweep_hour *hours)
+/*
+ * Computes the shared outdoor states of nh weather hours
+ * P = station pressure [kPa]
+ */
+{
+	int i, k, m;
+	double W[256], h[256], Tdp[256];
+
+	for(i = 0; i < nh; i += 256)
+	{
+		m = nh - i < 256 ? nh - i : 256;
+		hum_rat2_batch(Tdb + i, RH + i, P, W, m);
+		enthalpy_air_h2o_batch(Tdb + i, W, h, m);
+		dew_point_batch(P, W, Tdp, m);
+		for(k = 0; k < m; k++)
+		{
+			hours[i + k].Tdb = Tdb[i + k];
+			hours[i + k].RH = RH[i + k];
+			hours[i + k].W = W[k];
+			hours[i + k].h = h[k];
+			hours[i + k].Tdp = Tdp[k];
+		}
+	}
+}
+
+
+long sweep_count(const sweep_grid *g)
+/*
+ * Number of combinations in a grid
+ */
+{
+	int j;
+	long n = 1;
+	for(j = 0; j < g->np; j++)
+	{
+		n *= g->nval[j];
+	}
+	return n;
+}
+
+
+void sweep_params(const sweep_grid *g, long combo, double *param)
+/*
+ * Decodes a combination number into parameter values, the first
+ * parameter varying fastest
+ */
+{
+	int j;
+	for(j = 0; j < g->np; j++)
+	{
+		param[j] = g->val[j][combo % g->nval[j]];
+		combo /= g->nval[j];
+	}
+}
+
+
+int sweep_run(const sweep_grid *g, const sweep_hour *hours, int nh, sweep_model model,
+		int nout, const char *const *outname, void *ctx, const char *path)
+/*
+ * Runs every combination of the grid over nh hours and writes one row
+ * per combination: the parameters, then <out>_sum and <out>_max for each
+ * model output
+ * Returns 0 on success, -1 on bad arguments, memory or I/O error
+ */
+{
+	int j, ncols = g->np + 2 * nout;
+	long c0, total = sweep_count(g);
+	char names[SWEEP_MAXP + 2 * SWEEP_MAXOUT][COL_NAME];
+	const char *colname[SWEEP_MAXP + 2 * SWEEP_MAXOUT];
+	double *rows;
+	col_file *f;
+	int err = 0;
+
+	if(g->np < 1 || g->np > SWEEP_MAXP || nout < 1 || nout > SWEEP_MAXOUT || nh < 1)
+	{
+		return -1;
+	}
+	for(j = 0; j < g->np; j++)
+	{
+		snprintf(names[j], COL_NAME, "%s", g->name[j]);
+	}
+	for(j = 0; j < nout; j++)
+	{
+		snprintf(names[g->np + 2 * j], COL_NAME, "%.26s_sum", outname[j]);
+		snprintf(names[g->np + 2 * j + 1], COL_NAME, "%.26s_max", outname[j]);
+	}
+	for(j = 0; j < ncols; j++)
+	{
+		colname[j] = names[j];
+	}
+
+	rows = malloc(sizeof(double) * SWEEP_CHUNK * ncols);
+	f = col_create(path, ncols, colname);
+	if(!rows || !f)
+	{
+		free(rows);
+		col_close(f);
+		return -1;
+	}
+
+	for(c0 = 0; c0 < total && !err; c0 += SWEEP_CHUNK)
+	{
+		long c, m = total - c0 < SWEEP_CHUNK ? total - c0 : SWEEP_CHUNK;
+
+		#pragma omp parallel for schedule(dynamic, 8)
+		for(c = 0; c < m; c++)
+		{
+			int i, k;
+			double out[SWEEP_MAXOUT];
+			double *row = rows + c * ncols;
+			double *acc = row + g->np;
+
+			sweep_params(g, c0 + c, row);
+			for(k = 0; k < nout; k++)
+			{
+				acc[2 * k] = 0;
+				acc[2 * k + 1] = -HUGE_VAL;
+			}
+			for(i = 0; i < nh; i++)
+			{
+				model(row, &hours[i], out, ctx);
+				for(k = 0; k < nout; k++)
+				{
+					acc[2 * k] += out[k];
+					acc[2 * k + 1] = fmax(acc[2 * k + 1], out[k]);
+				}
+			}
+		}
+
+		for(j = 0; j < m && !err; j++)
+		{
+			err = col_append(f, rows + (size_t)j * ncols);
+		}
+	}
+
+	free(rows);
+	if(col_close(f) != 0)
+	{
+		err = -1;
+	}
+	return err;
+}
+
+
+/*
+ * Example model: ERV followed by a chilled water coil
+ * Parameters: face velocity [m/s], coil rows, supply air temperature [degC],
+ * ERV effectiveness (sensible and latent)
+ * Outputs: coil load [kW], ERV recovery [kW], coil air pressure drop [Pa]
+ */
+
+#define SWEEP_AHU_NOUT 3
+
+
+typedef struct
+{
+	double m_air;	// outdoor air dry air mass flow [kg/s]
+	double P;		// ambient pressure [kPa]
+	double Tra;		// return air dry bulb [degC]
+	double Wra;		// return air humidity ratio, computed once by sweep_ahu_init()
+	double hra;		// return air enthalpy, computed once by sweep_ahu_init()
+} sweep_ahu;
+
+
+void sweep_ahu_init(sweep_ahu *a, double m_air, double P, double Tra, double RHra)
+/*
+ * Sets up the example model, RHra = return air relative humidity [Fraction]
+ */
+{
+	a->m_air = m_air;
+	a->P = P;
+	a->Tra = Tra;
+	a->Wra = hum_rat2(Tra, RHra, P);
+	a->hra = enthalpy_air_h2o(Tra, a->Wra);
+}
+
+
+void sweep_ahu_model(const double *param, const sweep_hour *oa, double *out, void *ctx)
+/*
+ * sweep_model for the ERV and coil example, ctx is a sweep_ahu
+ * The coil bypass factor is exp(-0.58 rows sqrt(2.5 / v)), about 0.1 for
+ * 4 rows at 2.5 m/s, and the coil leaves at the supply temperature on the
+ * line to its apparatus dew point.  The ERV is bypassed when the outdoor
+ * air enthalpy is below the return air, as a cooling only coil would
+ * otherwise have to remove the recovered heat.
+ */
+{
+	const sweep_ahu *a = ctx;
+	double v = param[0], rows = param[1], Tsup = param[2];
+	double eps = oa->h > a->hra ? param[3] : 0;
+	double T = oa->Tdb + eps * (a->Tra - oa->Tdb);
+	double W = oa->W + eps * (a->Wra - oa->W);
+	double h = enthalpy_air_h2o(T, W);
+	double BF = exp(-0.58 * rows * sqrt(2.5 / v));
+
+	out[1] = a->m_air * (oa->h - h);
+	out[2] = 12 * rows * pow(v / 2.5, 1.8);
+
+	if(T > Tsup)
+	{
+		double ADP = (Tsup - BF * T) / (1 - BF);
+		double Wadp = hum_rat2(ADP, 1, a->P);
+		double Wout = W > Wadp ? Wadp + BF * (W - Wadp) : W;
+		out[0] = a->m_air * (h - enthalpy_air_h2o(Tsup, Wout));
+	}
+	else
+	{
+		out[0] = 0;
+	}
+}
+
+
+#endif
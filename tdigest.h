@@ -0,0 +1,237 @@
+/*
+ * tdigest.h
+ *
+ * Merging t-digest (Dunning and Ertl) for streaming quantiles.
+ *
+ * A digest keeps at most about TDIGEST_DELTA weighted centroids, clustered
+ * densely near q = 0 and q = 1, so tail percentiles such as the 0.4% and
+ * 99.6% design values stay accurate while memory is fixed no matter how
+ * many hours are added.  Digests built by separate workers can be merged.
+ *
+ */
+
+#ifndef TDIGEST_H
+#define TDIGEST_H
+#include <stdlib.h>
+#include <math.h>
+
+#define TDIGEST_DELTA 200	// compression, more centroids means tighter quantiles
+#define TDIGEST_CAP (TDIGEST_DELTA + 8)
+#define TDIGEST_BUF 512		// unmerged points held before a compress
+#define TDIGEST_PI 3.14159265358979323846
+
+
+typedef struct
+{
+	double mean;
+	double w;
+} tdigest_centroid;
+
+
+typedef struct
+{
+	int nc;					// centroids in c[]
+	int nb;					// unmerged points in buf[]
+	double total;			// total weight, merged and unmerged
+	double min;
+	double max;
+	tdigest_centroid c[TDIGEST_CAP];
+	tdigest_centroid buf[TDIGEST_BUF];
+} tdigest;
+
+
+void tdigest_init(tdigest *t)
+/*
+ * Empties a digest
+ */
+{
+	t->nc = 0;
+	t->nb = 0;
+	t->total = 0;
+	t->min = HUGE_VAL;
+	t->max = -HUGE_VAL;
+}
+
+
+int tdigest_cmp(const void *a, const void *b)
+/*
+ * qsort comparator on centroid mean
+ */
+{
+	double x = ((const tdigest_centroid *)a)->mean;
+	double y = ((const tdigest_centroid *)b)->mean;
+	return (x > y) - (x < y);
+}
+
+
+double tdigest_k(double q)
+/*
+ * k1 scale function, k(q) = delta / (2 pi) * asin(2q - 1)
+ */
+{
+	return TDIGEST_DELTA / (2 * TDIGEST_PI) * asin(2 * q - 1);
+}
+
+
+double tdigest_kinv(double k)
+/*
+ * Inverse of tdigest_k()
+ */
+{
+	if(k >= TDIGEST_DELTA / 4.0)
+	{
+		return 1;
+	}
+	return (sin(k * 2 * TDIGEST_PI / TDIGEST_DELTA) + 1) / 2;
+}
+
+
+void tdigest_compress(tdigest *t)
+/*
+ * Folds the buffered points into the centroids
+ */
+{
+	tdigest_centroid all[TDIGEST_CAP + TDIGEST_BUF];
+	int i, n = 0, out = 0;
+	double q0 = 0, qlimit, W = t->total;
+
+	if(t->nb == 0)
+	{
+		return;
+	}
+	for(i = 0; i < t->nc; i++)
+	{
+		all[n++] = t->c[i];
+	}
+	for(i = 0; i < t->nb; i++)
+	{
+		all[n++] = t->buf[i];
+	}
+	t->nb = 0;
+	qsort(all, n, sizeof(tdigest_centroid), tdigest_cmp);
+
+	qlimit = tdigest_kinv(tdigest_k(q0) + 1);
+	t->c[0] = all[0];
+	for(i = 1; i < n; i++)
+	{
+		double q = q0 + (t->c[out].w + all[i].w) / W;
+		// The scale function keeps out below TDIGEST_CAP; the guard only
+		// makes sure rounding can never write past c[]
+		if(q <= qlimit || out == TDIGEST_CAP - 1)
+		{
+			// Weighted running mean keeps the centroid exact
+			t->c[out].w += all[i].w;
+			t->c[out].mean += (all[i].mean - t->c[out].mean) * all[i].w / t->c[out].w;
+		}
+		else
+		{
+			q0 += t->c[out].w / W;
+			qlimit = tdigest_kinv(tdigest_k(q0) + 1);
+			t->c[++out] = all[i];
+		}
+	}
+	t->nc = out + 1;
+}
+
+
+void tdigest_add_weighted(tdigest *t, double x, double w)
+/*
+ * Adds x with weight w, ignoring NaN
+ */
+{
+	if(!(x == x) || w <= 0)
+	{
+		return;
+	}
+	if(t->nb == TDIGEST_BUF)
+	{
+		tdigest_compress(t);
+	}
+	t->buf[t->nb].mean = x;
+	t->buf[t->nb].w = w;
+	t->nb++;
+	t->total += w;
+	t->min = fmin(t->min, x);
+	t->max = fmax(t->max, x);
+}
+
+
+void tdigest_add(tdigest *t, double x)
+/*
+ * Adds one observation
+ */
+{
+	tdigest_add_weighted(t, x, 1);
+}
+
+
+void tdigest_merge(tdigest *t, tdigest *other)
+/*
+ * Adds every observation of other into t, e.g. to combine per thread
+ * or per station digests.  other is compressed but otherwise unchanged.
+ */
+{
+	int i;
+	double lo = other->min, hi = other->max;
+
+	tdigest_compress(other);
+	for(i = 0; i < other->nc; i++)
+	{
+		tdigest_add_weighted(t, other->c[i].mean, other->c[i].w);
+	}
+	// Centroid means lie inside the range, keep the true extremes
+	t->min = fmin(t->min, lo);
+	t->max = fmax(t->max, hi);
+}
+
+
+double tdigest_quantile(tdigest *t, double q)
+/*
+ * Estimates the q quantile (0 to 1), NaN if the digest is empty
+ */
+{
+	int i;
+	double target, cum, dw;
+	tdigest_centroid *c = t->c;
+
+	tdigest_compress(t);
+	if(t->nc == 0)
+	{
+		return NAN;
+	}
+	if(q <= 0)
+	{
+		return t->min;
+	}
+	if(q >= 1)
+	{
+		return t->max;
+	}
+	if(t->nc == 1)
+	{
+		return c[0].mean;
+	}
+
+	target = q * t->total;
+	if(target < c[0].w / 2)
+	{
+		return t->min + (c[0].mean - t->min) * target / (c[0].w / 2);
+	}
+
+	cum = c[0].w / 2;
+	for(i = 0; i < t->nc - 1; i++)
+	{
+		dw = (c[i].w + c[i + 1].w) / 2;
+		if(target < cum + dw)
+		{
+			return c[i].mean + (c[i + 1].mean - c[i].mean) * (target - cum) / dw;
+		}
+		cum += dw;
+	}
+
+	dw = c[t->nc - 1].w / 2;
+	return c[t->nc - 1].mean + (t->max - c[t->nc - 1].mean) * fmin(1, (target - cum) / dw);
+}
+
+
+#endif
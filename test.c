@@ -0,0 +1,188 @@
+/*
+ ============================================================================
+ Name        : test.c
+ Description : Checks of the property functions and file readers against
+               reference values; prints each failure and exits nonzero
+ Build       : cc -O2 test.c -o test -lm -pthread
+ Usage       : test
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "water.h"
+#include "trend.h"
+#include "pcache.h"
+#include "degday.h"
+
+static int failed;
+static const char log_no_newline[] = "Time,Tdb,RH\n1,20,0.5\n2,25,0.4\n3,30,0.3";	// last line unterminated
+static const char log_newline[] = "Time,Tdb,RH\n1,20,0.5\n2,25,0.4\n3,30,0.3\n";
+
+
+static void check(const char *what, double got, double want, double tol)
+/*
+ * Reports got when it differs from want by more than tol
+ */
+{
+	if(!(fabs(got - want) <= tol))
+	{
+		printf("FAIL %s: %.6g, expected %.6g +/- %g\n", what, got, want, tol);
+		failed++;
+	}
+}
+
+
+static void test_water_cp(void)
+/*
+ * water_cp() against IAPWS-95 at 101.325 kPa [kJ/kg K]
+ */
+{
+	check("water_cp(20)", water_cp(20), 4.1841, 0.002);
+	check("water_cp(60)", water_cp(60), 4.1850, 0.002);
+	check("water_cp(100)", water_cp(100), 4.2157, 0.002);
+	check("water_cp(37.5)", water_cp(37.5), 4.1794, 0.002);
+}
+
+
+
+static int temp_log(char *path, const char *text)
+/*
+ * Writes text to a new temporary file, path is a mkstemp() template
+ * Returns 0 on success, -1 on failure
+ */
+{
+	int fd = mkstemp(path);
+	size_t len = strlen(text);
+	if(fd < 0)
+	{
+		return -1;
+	}
+	if(write(fd, text, len) != (ssize_t)len)
+	{
+		close(fd);
+		return -1;
+	}
+	return close(fd);
+}
+
+
+static void test_trend_last_line(void)
+/*
+ * A log read once must convert a last line that has no newline
+ */
+{
+	char path[] = "/tmp/trendXXXXXX";
+	trend_reader r;
+	FILE *out = tmpfile();
+
+	if(!out || temp_log(path, log_no_newline) != 0 || trend_open(&r, path, out, 101.325) != 0)
+	{
+		printf("FAIL trend: cannot create %s\n", path);
+		failed++;
+		return;
+	}
+	check("trend_poll() rows", trend_poll(&r), 2, 0);
+	check("trend_finish() rows", trend_finish(&r), 1, 0);
+	check("trend_finish() again", trend_finish(&r), 0, 0);
+	trend_close(&r);
+	fclose(out);
+	unlink(path);
+}
+
+
+static int count_lines(FILE *f)
+/*
+ * Counts the newlines from the start of f
+ */
+{
+	int c, n = 0;
+	rewind(f);
+	while((c = getc(f)) != EOF)
+	{
+		n += c == '\n';
+	}
+	return n;
+}
+
+
+static void test_pcache_last_line(void)
+/*
+ * pcache_run() must convert a last line that has no newline, and key that
+ * chunk as if the newline were there
+ */
+{
+	char path[] = "/tmp/trendXXXXXX", path2[] = "/tmp/trendXXXXXX", dir[] = "/tmp/pcacheXXXXXX", entry[4096];
+	trend_reader cfg;
+	pcache_stats st;
+	FILE *out = tmpfile(), *out2 = tmpfile();
+	DIR *d;
+	struct dirent *e;
+
+	if(!out || !out2 || !mkdtemp(dir) || temp_log(path, log_no_newline) != 0 || temp_log(path2, log_newline) != 0
+		|| trend_open(&cfg, path, NULL, 101.325) != 0)
+	{
+		printf("FAIL pcache: cannot create %s\n", dir);
+		failed++;
+		return;
+	}
+	check("pcache_run()", pcache_run(&cfg, path, dir, out, &st), 0, 0);
+	check("pcache_run() lines", count_lines(out), 4, 0);
+	check("pcache_run() terminated log", pcache_run(&cfg, path2, dir, out2, &st), 0, 0);
+	check("pcache_run() terminated log hits", st.hits, 1, 0);
+	check("pcache_run() terminated log lines", count_lines(out2), 4, 0);
+	trend_close(&cfg);
+	fclose(out);
+	fclose(out2);
+	unlink(path);
+	unlink(path2);
+	if((d = opendir(dir)) != NULL)
+	{
+		while((e = readdir(d)) != NULL)
+		{
+			snprintf(entry, sizeof(entry), "%s/%s", dir, e->d_name);
+			unlink(entry);		// fails harmlessly for . and ..
+		}
+		closedir(d);
+	}
+	rmdir(dir);
+}
+
+
+static void test_degday_missing_rh(void)
+/*
+ * An hour with RH missing still counts in the degree-days and hours above
+ * base, but not in the enthalpy-hours
+ */
+{
+	const double Tdb[3] = {30, 30, NAN}, RH[3] = {0.5, NAN, 0.5};
+	double one[DEGDAY_NOUT], all[DEGDAY_NOUT];
+	degday_base b;
+
+	degday_base_point(&b, 24, 0.5, 101.325);
+	degday_station(Tdb, RH, 101.325, 1, &b, 1, one);
+	degday_station(Tdb, RH, 101.325, 3, &b, 1, all);
+	check("degday CDD", all[DEGDAY_CDD], 2 * one[DEGDAY_CDD], 1E-12);
+	check("degday HOURS", all[DEGDAY_HOURS], 2, 0);
+	check("degday EH", all[DEGDAY_EH], one[DEGDAY_EH], 1E-12);
+	check("degday LATENT", all[DEGDAY_LATENT], one[DEGDAY_LATENT], 1E-12);
+}
+
+
+int main(void)
+{
+	test_water_cp();
+	test_trend_last_line();
+	test_pcache_last_line();
+	test_degday_missing_rh();
+	if(failed)
+	{
+		printf("%d failed\n", failed);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,423 @@
+/*
+ * trend.h
+ *
+ * Trend log (CSV) processing with a follow mode for growing files.
+ *
+ * A trend_reader remembers the byte offset it has consumed.  Each call to
+ * trend_poll() reads only what was appended since, carries a partial last
+ * line over to the next call, and writes every complete row back out with
+ * humidity ratio, enthalpy and dew point appended.  trend_finish() takes
+ * the partial last line as a row once the file is known complete.
+ * trend_follow() blocks on inotify between polls, so appended rows are
+ * processed as soon as the BAS writes them without rescanning the file.
+ * A file that shrinks is taken as truncated and read again from the start;
+ * a file that is moved or deleted (log rotation) is reopened by name.
+ *
+ * With col set the rows go to a colfile.h result file instead, as the
+ * TREND_NCOLS columns named in trend_col_names (SI units).  With vpd set
+ * the air VPD of every row also goes into that vpd.h rolling window, and
+ * CSV output gains a VPD column.
+ *
+ */
+
+#ifndef TREND_H
+#define TREND_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "psych.h"
+#include "psych_batch.h"
+#include "metrics.h"
+#include "colfile.h"
+#include "csvscan.h"
+#include "vpd.h"
+
+#define TREND_BUF 65536		// read buffer, also the longest line accepted
+#define TREND_BATCH 256		// rows converted per batch call
+#define TREND_NCOLS 5
+#define TREND_MAXCOL 256	// highest column number tcol and rhcol can name
+
+const char *const trend_col_names[TREND_NCOLS] = {"Tdb", "RH", "W", "h", "Tdp"};
+
+
+typedef struct
+{
+	const char *path;
+	int fd;
+	off_t offset;			// bytes of the file consumed, complete lines only
+	char buf[TREND_BUF];
+	int len;				// bytes in buf, the unfinished last line
+
+	int tcol;				// column of the dry bulb, first column is 0
+	int rhcol;				// column of the relative humidity
+	int fahrenheit;			// dry bulb in F instead of degC
+	int percent;			// RH in % instead of a fraction
+	double P;				// pressure [kPa]
+	FILE *out;
+	col_file *col;			// when set, rows are stored here instead of out
+	vpd_window *vpd;		// when set, receives the air VPD of every row
+
+	long rows;				// rows written
+	long skipped;			// lines that did not parse (headers, blanks)
+	int header;				// the next line is the first of the log, and may be its header
+
+	// Current batch: the rows refer into buf until the batch is written
+	int nb;
+	const char *line[TREND_BATCH];
+	int linelen[TREND_BATCH];
+	double Tdb[TREND_BATCH];
+	double RH[TREND_BATCH];
+} trend_reader;
+
+
+int trend_open(trend_reader *r, const char *path, FILE *out, double P)
+/*
+ * Opens a trend log, reading from the beginning
+ * Defaults: dry bulb in column 1 [degC], RH in column 2 [Fraction]; set
+ * tcol, rhcol, fahrenheit and percent after opening to change them
+ * Returns 0 on success, -1 if the file cannot be opened
+ */
+{
+	memset(r, 0, sizeof(*r));
+	r->path = path;
+	r->out = out;
+	r->P = P;
+	r->tcol = 1;
+	r->rhcol = 2;
+	r->header = 1;
+	r->fd = open(path, O_RDONLY);
+	return r->fd < 0 ? -1 : 0;
+}
+
+
+void trend_close(trend_reader *r)
+/*
+ * Closes the file
+ */
+{
+	if(r->fd >= 0)
+	{
+		close(r->fd);
+	}
+	r->fd = -1;
+}
+
+
+int trend_field(const char *s, int len, int col, double *v)
+/*
+ * Parses column col of a CSV line of len bytes
+ * Returns 0 on success, -1 if the column is missing or not a number
+ */
+{
+	int pos[TREND_MAXCOL];
+	if(col < 0 || col >= TREND_MAXCOL)
+	{
+		return -1;
+	}
+	return csv_field(s, len, pos, csv_split(s, len, ',', pos, col), col, v);
+}
+
+
+void trend_flush(trend_reader *r)
+/*
+ * Converts the current batch and writes its rows
+ */
+{
+	int k;
+	double W[TREND_BATCH], h[TREND_BATCH], Tdp[TREND_BATCH], vpd[TREND_BATCH];
+	uint64_t t0 = metrics_clock();
+
+	if(r->nb == 0)
+	{
+		return;
+	}
+	hum_rat2_batch(r->Tdb, r->RH, r->P, W, r->nb);
+	enthalpy_air_h2o_batch(r->Tdb, W, h, r->nb);
+	dew_point_batch(r->P, W, Tdp, r->nb);
+	if(r->vpd)
+	{
+		vpd_batch(r->Tdb, r->RH, NULL, r->P, r->nb, vpd, NULL, NULL);
+	}
+	for(k = 0; k < r->nb; k++)
+	{
+		if(r->vpd)
+		{
+			vpd_window_add(r->vpd, vpd[k]);
+		}
+		if(r->col)
+		{
+			double row[TREND_NCOLS];
+			row[0] = r->Tdb[k];
+			row[1] = r->RH[k];
+			row[2] = W[k];
+			row[3] = h[k];
+			row[4] = Tdp[k];
+			col_append(r->col, row);
+		}
+		else if(r->vpd)
+		{
+			fprintf(r->out, "%.*s,%.6f,%.3f,%.2f,%.3f\n", r->linelen[k], r->line[k], W[k], h[k], Tdp[k], vpd[k]);
+		}
+		else
+		{
+			fprintf(r->out, "%.*s,%.6f,%.3f,%.2f\n", r->linelen[k], r->line[k], W[k], h[k], Tdp[k]);
+		}
+	}
+	r->rows += r->nb;
+	metric_add(METRIC_ROWS, r->nb);
+	metric_add(METRIC_BATCHES, 1);
+	metric_observe(METRIC_BATCH_ROWS, r->nb);
+	metric_observe(METRIC_LAT_TREND_FLUSH, metrics_clock() - t0);
+	r->nb = 0;
+}
+
+
+void trend_line(trend_reader *r, const char *s, int len)
+/*
+ * Queues one complete line (without its newline)
+ */
+{
+	double T, RH;
+	int pos[TREND_MAXCOL];
+	int npos, last = r->tcol > r->rhcol ? r->tcol : r->rhcol;
+	int first = r->header;
+
+	r->header = 0;
+
+	if(len > 0 && s[len - 1] == '\r')
+	{
+		len--;
+	}
+	// Split once up to the last column needed, then parse the two fields
+	npos = csv_split(s, len, ',', pos, last < TREND_MAXCOL ? last : TREND_MAXCOL);
+	if(csv_field(s, len, pos, npos, r->tcol, &T) != 0 || csv_field(s, len, pos, npos, r->rhcol, &RH) != 0)
+	{
+		if(first && len > 0 && !r->col)
+		{
+			fprintf(r->out, "%.*s,W,h,Tdp%s\n", len, s, r->vpd ? ",VPD" : "");	// header row
+		}
+		r->skipped++;
+		metric_add(METRIC_ROWS_REJECTED, 1);
+		return;
+	}
+	if(r->fahrenheit)
+	{
+		T = (T - 32) / 1.8;
+	}
+	if(r->percent)
+	{
+		RH /= 100;
+	}
+	r->line[r->nb] = s;
+	r->linelen[r->nb] = len;
+	r->Tdb[r->nb] = T;
+	r->RH[r->nb] = RH;
+	if(++r->nb == TREND_BATCH)
+	{
+		trend_flush(r);
+	}
+}
+
+
+long trend_poll(trend_reader *r)
+/*
+ * Processes everything appended since the last call
+ * Returns the number of rows written, or -1 on a read error
+ */
+{
+	long before = r->rows;
+	struct stat st;
+
+	if(fstat(r->fd, &st) == 0 && st.st_size < r->offset)
+	{
+		r->offset = 0;	// truncated, start over
+		r->len = 0;
+	}
+
+	for(;;)
+	{
+		ssize_t got = pread(r->fd, r->buf + r->len, TREND_BUF - r->len, r->offset + r->len);
+		int start = 0;
+		char *nl;
+
+		if(got < 0)
+		{
+			return -1;
+		}
+		if(got == 0)
+		{
+			break;
+		}
+		r->len += got;
+
+		// memchr() is vectorized in common C libraries
+		while((nl = memchr(r->buf + start, '\n', r->len - start)) != NULL)
+		{
+			trend_line(r, r->buf + start, (int)(nl - r->buf) - start);
+			start = (int)(nl - r->buf) + 1;
+		}
+		trend_flush(r);		// rows point into buf, write them before it moves
+
+		if(start == 0 && r->len == TREND_BUF)
+		{
+			start = r->len;		// line longer than the buffer, drop it
+			r->skipped++;
+			metric_add(METRIC_ROWS_REJECTED, 1);
+		}
+		r->offset += start;
+		r->len -= start;
+		memmove(r->buf, r->buf + start, r->len);
+	}
+	if(r->col)
+	{
+		col_flush(r->col);
+	}
+	else
+	{
+		fflush(r->out);
+	}
+	return r->rows - before;
+}
+
+
+long trend_finish(trend_reader *r)
+/*
+ * Processes the unfinished last line left by trend_poll(), for a file that
+ * is complete (not followed, or rotated away) and may lack a final newline
+ * Returns the number of rows written
+ */
+{
+	long before = r->rows;
+
+	if(r->len > 0)
+	{
+		trend_line(r, r->buf, r->len);
+		trend_flush(r);
+		r->offset += r->len;
+		r->len = 0;
+	}
+	if(r->col)
+	{
+		col_flush(r->col);
+	}
+	else
+	{
+		fflush(r->out);
+	}
+	return r->rows - before;
+}
+
+
+#ifdef __linux__
+int trend_reopen(trend_reader *r, int in, int *wd, uint32_t mask)
+/*
+ * Switches to the file now at r->path after a rotation and watches it
+ * Returns 0 on success, -1 if the new file does not exist yet
+ */
+{
+	int fd = open(r->path, O_RDONLY);
+	if(fd < 0)
+	{
+		return -1;
+	}
+	close(r->fd);
+	r->fd = fd;
+	r->offset = 0;
+	r->len = 0;
+	if(*wd >= 0)
+	{
+		inotify_rm_watch(in, *wd);
+	}
+	*wd = inotify_add_watch(in, r->path, mask);
+	return 0;
+}
+#endif
+
+
+int trend_follow(trend_reader *r, volatile sig_atomic_t *stop)
+/*
+ * Processes the file, then keeps waiting for appended data until *stop
+ * becomes non zero (e.g. set from a signal handler)
+ * Uses inotify on Linux and a one second poll elsewhere.
+ * Returns 0 when stopped, -1 on error
+ */
+{
+#ifdef __linux__
+	int in = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	int wd = -1;
+	int lost = 0;
+	uint32_t mask = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+
+	if(in < 0)
+	{
+		return -1;
+	}
+	wd = inotify_add_watch(in, r->path, mask);
+#endif
+
+	while(!*stop)
+	{
+		if(trend_poll(r) < 0)
+		{
+			break;
+		}
+#ifdef __linux__
+		{
+			struct pollfd p;
+			char ev[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+			ssize_t n;
+			int reopen = 0;
+
+			if(lost)
+			{
+				lost = trend_reopen(r, in, &wd, mask) != 0;
+			}
+			p.fd = in;
+			p.events = POLLIN;
+			if(poll(&p, 1, lost ? 50 : 1000) <= 0)
+			{
+				continue;	// timeout or signal, check *stop and retry a lost file
+			}
+			while((n = read(in, ev, sizeof(ev))) > 0)
+			{
+				char *e = ev;
+				while(e < ev + n)
+				{
+					struct inotify_event *ie = (struct inotify_event *)e;
+					if(ie->wd == wd && (ie->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)))
+					{
+						reopen = 1;
+					}
+					e += sizeof(struct inotify_event) + ie->len;
+				}
+			}
+			if(reopen)
+			{
+				// Rotated: finish the old file, then start the new one from 0
+				trend_poll(r);
+				trend_finish(r);
+				lost = trend_reopen(r, in, &wd, mask) != 0;
+			}
+		}
+#else
+		sleep(1);
+#endif
+	}
+
+#ifdef __linux__
+	close(in);
+#endif
+	return *stop ? 0 : -1;
+}
+
+
+#endif
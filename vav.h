@@ -0,0 +1,126 @@
+/*
+ * vav.h
+ *
+ * Airflow normalization for VAV fleets, actual vs standard airflow.
+ *
+ * Moist air density comes from dry_air_density() at the site pressure,
+ * which is looked up once per site from the elevation cache in site.h
+ * rather than recomputed for every box.  Flow units are left to the
+ * caller: any volumetric unit (CFM, L/s, m^3/h) converts the same way.
+ *
+ */
+
+#ifndef VAV_H
+#define VAV_H
+#include <math.h>
+#include "psych.h"
+#include "psych_batch.h"
+#include "site.h"
+
+#define VAV_RHO_STD 1.2041		// standard air, 20 degC dry at 101.325 kPa [kg/m^3]
+#define VAV_CHUNK 256			// boxes per batch call
+
+
+double moist_air_density(double P, double Tdb, double W)
+/*
+ * Density of the air-h2o mixture [kg/m^3], as outType 10 of psych()
+ * P = pressure [kPa]
+ * Tdb = Dry bulb temperature [degC]
+ * W = humidity ratio [kg/kg dry air]
+ */
+{
+	return dry_air_density(P, Tdb, W) * (1 + W);
+}
+
+
+double vav_to_standard(double Qact, double P, double Tdb, double W)
+/*
+ * Converts an actual volumetric flow (ACFM) to standard flow (SCFM)
+ * Qact = actual flow, any volumetric unit
+ * P, Tdb, W = air state at the flow station [kPa], [degC], [kg/kg]
+ */
+{
+	return Qact * moist_air_density(P, Tdb, W) / VAV_RHO_STD;
+}
+
+
+double vav_to_actual(double Qstd, double P, double Tdb, double W)
+/*
+ * Converts a standard flow (SCFM) to actual flow (ACFM)
+ */
+{
+	return Qstd * VAV_RHO_STD / moist_air_density(P, Tdb, W);
+}
+
+
+void vav_normalize(const site *s, const double *Tdb, const double *W, const double *Qact,
+		int n, double *Qstd)
+/*
+ * Converts one time step of n box readings at a site to standard flow
+ * s = site from site_lookup(), supplies the pressure
+ * Tdb = discharge air temperatures [degC]
+ * W = humidity ratios [kg/kg dry air], e.g. the AHU supply value for every box
+ * Qact = actual flows
+ * Qstd = output standard flows, may alias Qact
+ */
+{
+	int i, k, m;
+	double rho[VAV_CHUNK];
+
+	for(i = 0; i < n; i += VAV_CHUNK)
+	{
+		m = n - i < VAV_CHUNK ? n - i : VAV_CHUNK;
+		dry_air_density_batch(s->P, Tdb + i, W + i, rho, m);
+		#pragma omp simd
+		for(k = 0; k < m; k++)
+		{
+			Qstd[i + k] = Qact[i + k] * rho[k] * (1 + W[i + k]) / VAV_RHO_STD;
+		}
+	}
+}
+
+
+void vav_velocity_correct(const site *s, const double *Tdb, const double *W, const double *Qind,
+		int n, double *Qact)
+/*
+ * Corrects n flows indicated by velocity pressure sensors calibrated for
+ * standard air.  Velocity goes as sqrt(dp / rho), so the actual flow is
+ * Qind * sqrt(rho_std / rho).
+ * Qact = output actual flows, may alias Qind
+ */
+{
+	int i, k, m;
+	double rho[VAV_CHUNK];
+
+	for(i = 0; i < n; i += VAV_CHUNK)
+	{
+		m = n - i < VAV_CHUNK ? n - i : VAV_CHUNK;
+		dry_air_density_batch(s->P, Tdb + i, W + i, rho, m);
+		#pragma omp simd
+		for(k = 0; k < m; k++)
+		{
+			Qact[i + k] = Qind[i + k] * sqrt(VAV_RHO_STD / (rho[k] * (1 + W[i + k])));
+		}
+	}
+}
+
+
+void vav_fleet(site_cache *c, const double *elevation, const int *box_start, int nsites,
+		const double *Tdb, const double *W, const double *Qact, double *Qstd)
+/*
+ * Normalizes one time step for boxes grouped by site
+ * elevation = nsites site elevations [m]
+ * box_start = nsites + 1 offsets, the boxes of site j are box_start[j] to box_start[j + 1] - 1
+ */
+{
+	int j;
+	for(j = 0; j < nsites; j++)
+	{
+		const site *s = site_lookup(c, elevation[j]);
+		int b = box_start[j];
+		vav_normalize(s, Tdb + b, W + b, Qact + b, box_start[j + 1] - b, Qstd + b);
+	}
+}
+
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * vpd.h
+ *
+ * Greenhouse vapor pressure deficit analytics.
+ *
+ * VPD is taken against the leaf (sat_press at leaf temperature minus the
+ * air's partial vapor pressure) when a leaf temperature is available and
+ * against the air otherwise.  vpd_batch() evaluates a whole scan of sensors
+ * with the batch kernels and vpd_window keeps rolling statistics per
+ * sensor with one update per sample, like the drift.h detectors.  The
+ * running sum is recomputed from the ring buffer each time it wraps, so
+ * rounding cannot build up over a long stream, and the standard deviation
+ * is taken from the buffer in two passes.
+ *
+ */
+
+#ifndef VPD_H
+#define VPD_H
+#include <stddef.h>
+#include <math.h>
+#include "psych.h"
+#include "psych_batch.h"
+
+#define VPD_WINDOW 60		// samples in the rolling window, e.g. one hour of minute data
+#define VPD_CHUNK 256		// sensors per batch call
+#define VPD_RV 461.52		// gas constant of water vapor [J/kg K]
+
+
+double vpd_leaf(double W, double Tleaf, double P)
+/*
+ * Leaf to air vapor pressure deficit [kPa]
+ * W = humidity ratio [kg/kg dry air]
+ * Tleaf = Leaf temperature [degC], pass the dry bulb for the air VPD
+ * P = ambient pressure [kPa]
+ */
+{
+	return sat_press(Tleaf) - part_press(P, W);
+}
+
+
+double vpd_air(double Tdb, double RH)
+/*
+ * Air vapor pressure deficit [kPa]
+ * Tdb = Dry bulb temperature [degC]
+ * RH = Relative humidity [Fraction]
+ */
+{
+	return (1 - RH) * sat_press(Tdb);
+}
+
+
+double hum_deficit(double Tdb, double RH)
+/*
+ * Absolute humidity deficit [g/m^3], water the air can still take up
+ * Tdb = Dry bulb temperature [degC]
+ * RH = Relative humidity [Fraction]
+ */
+{
+	return (1 - RH) * sat_press(Tdb) * 1e6 / (VPD_RV * (Tdb + 273.15));
+}
+
+
+void vpd_batch(const double *Tdb, const double *RH, const double *Tleaf, double P, int n,
+		double *vpd, double *dew_margin, double *hd)
+/*
+ * Evaluates n greenhouse sensors
+ * Tdb = dry bulb temperatures [degC]
+ * RH = relative humidities [Fraction]
+ * Tleaf = leaf temperatures [degC], NULL to use the air temperature
+ * P = ambient pressure [kPa]
+ * vpd = output, leaf (or air) VPD [kPa]
+ * dew_margin = output, leaf (or air) temperature minus dew point [degC],
+ *              condensation on the leaf once it reaches zero; may be NULL
+ * hd = output, absolute humidity deficit [g/m^3]; may be NULL
+ */
+{
+	int i, k, m;
+	double Pws[VPD_CHUNK], W[VPD_CHUNK], Pw[VPD_CHUNK], tmp[VPD_CHUNK];
+
+	for(i = 0; i < n; i += VPD_CHUNK)
+	{
+		const double *T = Tdb + i;
+		const double *Ts = Tleaf ? Tleaf + i : T;
+		m = n - i < VPD_CHUNK ? n - i : VPD_CHUNK;
+
+		sat_press_batch(T, Pws, m);
+		hum_rat2_batch(T, RH + i, P, W, m);
+		part_press_batch(P, W, Pw, m);
+
+		if(hd)
+		{
+			for(k = 0; k < m; k++)
+			{
+				hd[i + k] = (Pws[k] - Pw[k]) * 1e6 / (VPD_RV * (T[k] + 273.15));
+			}
+		}
+		if(Tleaf)
+		{
+			sat_press_batch(Ts, tmp, m);
+		}
+		for(k = 0; k < m; k++)
+		{
+			vpd[i + k] = (Tleaf ? tmp[k] : Pws[k]) - Pw[k];
+		}
+		if(dew_margin)
+		{
+			dew_point_batch(P, W, tmp, m);
+			for(k = 0; k < m; k++)
+			{
+				dew_margin[i + k] = Ts[k] - tmp[k];
+			}
+		}
+	}
+}
+
+
+typedef struct
+{
+	double x[VPD_WINDOW];	// ring buffer of the last samples
+	int next;				// slot the next sample goes into
+	int n;					// samples in the window
+	double sum;				// of the samples in the window
+	double lo;				// target band [kPa]
+	double hi;
+	long below;				// samples below the band since init
+	long above;				// samples above the band since init
+} vpd_window;
+
+
+void vpd_window_init(vpd_window *w, double lo, double hi)
+/*
+ * Empties a rolling window, lo and hi are the target VPD band [kPa]
+ * e.g. 0.8 to 1.2 kPa for vegetative growth
+ */
+{
+	w->next = 0;
+	w->n = 0;
+	w->sum = 0;
+	w->lo = lo;
+	w->hi = hi;
+	w->below = 0;
+	w->above = 0;
+}
+
+
+void vpd_window_add(vpd_window *w, double vpd)
+/*
+ * Adds one VPD sample [kPa]; NaN samples are ignored
+ */
+{
+	if(!isfinite(vpd))
+	{
+		return;
+	}
+	if(w->n == VPD_WINDOW)
+	{
+		w->sum -= w->x[w->next];
+	}
+	else
+	{
+		w->n++;
+	}
+	w->x[w->next] = vpd;
+	w->next = (w->next + 1) % VPD_WINDOW;
+	w->sum += vpd;
+	if(w->next == 0)
+	{
+		int i;
+		for(w->sum = 0, i = 0; i < w->n; i++)
+		{
+			w->sum += w->x[i];		// drop the rounding of the last VPD_WINDOW updates
+		}
+	}
+	w->below += vpd < w->lo;
+	w->above += vpd > w->hi;
+}
+
+
+double vpd_window_mean(const vpd_window *w)
+/*
+ * Mean VPD over the window [kPa], NaN when empty
+ */
+{
+	return w->n ? w->sum / w->n : NAN;
+}
+
+
+double vpd_window_std(const vpd_window *w)
+/*
+ * Standard deviation of VPD over the window [kPa]
+ */
+{
+	double m, v = 0;
+	int i;
+	if(w->n < 2)
+	{
+		return 0;
+	}
+	m = w->sum / w->n;
+	for(i = 0; i < w->n; i++)
+	{
+		v += (w->x[i] - m) * (w->x[i] - m);
+	}
+	return sqrt(v / w->n);
+}
+
+
+void vpd_scan(vpd_window *w, const double *Tdb, const double *RH, const double *Tleaf,
+		double P, int n, double *vpd)
+/*
+ * Evaluates one scan of n sensors and pushes each VPD into its window
+ * vpd = scratch / output array of n VPD values [kPa]
+ */
+{
+	int i;
+	vpd_batch(Tdb, RH, Tleaf, P, n, vpd, NULL, NULL);
+	for(i = 0; i < n; i++)
+	{
+		vpd_window_add(&w[i], vpd[i]);
+	}
+}
+
+
+#endif
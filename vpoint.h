@@ -0,0 +1,319 @@
+/*
+ * vpoint.h
+ *
+ * Virtual point dependency graph with deadband recomputation.
+ *
+ * BMS virtual points (mixed air enthalpy, coil latent load, economizer
+ * availability, ...) are defined as psych.h functions or arithmetic of
+ * other points.  A point can only use points defined before it, so the
+ * definition order is already a topological order and vp_scan() is one
+ * pass over the nodes.  A node is recomputed only when one of its inputs
+ * changed in this scan, and it counts as changed itself only when its
+ * value moved by more than its deadband since it last propagated, so
+ * sensor noise stops at the first node that does not care about it.
+ *
+ * Changes are marked with the scan number (epoch), so nothing has to be
+ * cleared between scans.
+ *
+ */
+
+#ifndef VPOINT_H
+#define VPOINT_H
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "psych.h"
+
+#define VP_NAME 32			// bytes per point name, including the terminator
+#define VP_MAXIN 3			// inputs of a node
+
+// Node operations, inputs in the order listed
+#define VP_INPUT 0			// raw sensor or constant, set with vp_set()
+#define VP_ADD 1			// a + b
+#define VP_SUB 2			// a - b
+#define VP_MUL 3			// a * b
+#define VP_DIV 4			// a / b
+#define VP_MIX 5			// c a + (1 - c) b, e.g. mixing with outdoor air fraction c
+#define VP_LESS 6			// 1 if a < b, else 0
+#define VP_HUM_RAT2 7		// hum_rat2(Tdb, RH, P)
+#define VP_REL_HUM2 8		// rel_hum2(Tdb, W, P)
+#define VP_ENTHALPY 9		// enthalpy_air_h2o(Tdb, W)
+#define VP_DEW_POINT 10		// dew_point(P, W)
+#define VP_DENSITY 11		// dry_air_density(P, Tdb, W)
+#define VP_TDB_HW 12		// dry bulb from enthalpy h and humidity ratio W
+
+
+typedef struct
+{
+	char name[VP_NAME];
+	int op;
+	int in[VP_MAXIN];
+	double deadband;	// smallest change that propagates, in the point's units
+	double value;		// latest value
+	double sent;		// value at the last propagated change, NaN before the first
+	long stamp;			// scan in which the point last changed
+} vp_node;
+
+
+typedef struct
+{
+	int n;				// nodes defined
+	int cap;
+	vp_node *node;
+	long epoch;			// scans run
+	long evals;			// node recomputations, for comparing against n * epoch
+} vp_graph;
+
+
+int vp_arity(int op)
+/*
+ * Number of inputs of an operation, -1 if unknown
+ */
+{
+	switch(op)
+	{
+	case VP_INPUT:
+		return 0;
+	case VP_ADD: case VP_SUB: case VP_MUL: case VP_DIV: case VP_LESS:
+	case VP_ENTHALPY: case VP_DEW_POINT: case VP_TDB_HW:
+		return 2;
+	case VP_MIX: case VP_HUM_RAT2: case VP_REL_HUM2: case VP_DENSITY:
+		return 3;
+	}
+	return -1;
+}
+
+
+void vp_init(vp_graph *g)
+/*
+ * Starts an empty graph
+ */
+{
+	memset(g, 0, sizeof(*g));
+}
+
+
+void vp_free(vp_graph *g)
+/*
+ * Frees the nodes of a graph
+ */
+{
+	free(g->node);
+	memset(g, 0, sizeof(*g));
+}
+
+
+int vp_find(const vp_graph *g, const char *name)
+/*
+ * Index of a point by name, -1 if absent
+ */
+{
+	int i;
+	for(i = 0; i < g->n; i++)
+	{
+		if(strncmp(g->node[i].name, name, VP_NAME) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+int vp_define(vp_graph *g, const char *name, int op, int a, int b, int c, double deadband)
+/*
+ * Adds a point computed by op from the points a, b, c (unused inputs are
+ * ignored), or a raw input for op = VP_INPUT
+ * Inputs must already be defined, which keeps the graph acyclic.
+ * The new point is computed in the next vp_scan().
+ * Returns the index of the point, -1 on an unknown op, a bad input, a
+ * duplicate name or out of memory
+ */
+{
+	int k, nin = vp_arity(op);
+	int in[VP_MAXIN];
+	vp_node *p;
+
+	in[0] = a;
+	in[1] = b;
+	in[2] = c;
+	if(nin < 0 || vp_find(g, name) >= 0)
+	{
+		return -1;
+	}
+	for(k = 0; k < nin; k++)
+	{
+		if(in[k] < 0 || in[k] >= g->n)
+		{
+			return -1;
+		}
+	}
+	if(g->n == g->cap)
+	{
+		int cap = g->cap ? 2 * g->cap : 16;
+		vp_node *q = realloc(g->node, sizeof(vp_node) * cap);
+		if(!q)
+		{
+			return -1;
+		}
+		g->node = q;
+		g->cap = cap;
+	}
+
+	p = &g->node[g->n];
+	memset(p, 0, sizeof(*p));
+	strncpy(p->name, name, VP_NAME - 1);
+	p->op = op;
+	for(k = 0; k < VP_MAXIN; k++)
+	{
+		p->in[k] = k < nin ? in[k] : -1;
+	}
+	p->deadband = deadband;
+	p->value = NAN;
+	p->sent = NAN;
+	p->stamp = g->epoch + 1;
+	return g->n++;
+}
+
+
+int vp_input(vp_graph *g, const char *name, double value, double deadband)
+/*
+ * Adds a raw input (sensor, setpoint or constant) with its first value
+ * Returns the index of the point, -1 on error as vp_define()
+ */
+{
+	int i = vp_define(g, name, VP_INPUT, -1, -1, -1, deadband);
+	if(i >= 0)
+	{
+		g->node[i].value = value;
+		g->node[i].sent = value;
+	}
+	return i;
+}
+
+
+int vp_moved(vp_node *p, long epoch)
+/*
+ * Marks p changed in scan epoch if it moved beyond its deadband
+ * A NaN value, or the first value, always counts as a change.
+ */
+{
+	if(fabs(p->value - p->sent) <= p->deadband)
+	{
+		return 0;
+	}
+	p->sent = p->value;
+	p->stamp = epoch;
+	return 1;
+}
+
+
+void vp_set(vp_graph *g, int i, double value)
+/*
+ * Sets a raw input, taking effect in the next vp_scan()
+ */
+{
+	vp_node *p = &g->node[i];
+	if(p->op != VP_INPUT)
+	{
+		return;
+	}
+	p->value = value;
+	vp_moved(p, g->epoch + 1);
+}
+
+
+double vp_eval(const vp_graph *g, const vp_node *p)
+/*
+ * Computes a node from the current values of its inputs
+ */
+{
+	double a = p->in[0] >= 0 ? g->node[p->in[0]].value : 0;
+	double b = p->in[1] >= 0 ? g->node[p->in[1]].value : 0;
+	double c = p->in[2] >= 0 ? g->node[p->in[2]].value : 0;
+
+	switch(p->op)
+	{
+	case VP_ADD:
+		return a + b;
+	case VP_SUB:
+		return a - b;
+	case VP_MUL:
+		return a * b;
+	case VP_DIV:
+		return a / b;
+	case VP_MIX:
+		return c * a + (1 - c) * b;
+	case VP_LESS:
+		return a < b ? 1 : 0;
+	case VP_HUM_RAT2:
+		return hum_rat2(a, b, c);
+	case VP_REL_HUM2:
+		return rel_hum2(a, b, c);
+	case VP_ENTHALPY:
+		return enthalpy_air_h2o(a, b);
+	case VP_DEW_POINT:
+		return dew_point(a, b);
+	case VP_DENSITY:
+		return dry_air_density(a, b, c);
+	case VP_TDB_HW:
+		return (a - 2501 * b) / (1.006 + 1.86 * b);	// enthalpy_air_h2o() solved for Tdb
+	}
+	return p->value;
+}
+
+
+int vp_scan(vp_graph *g)
+/*
+ * Propagates the inputs set since the last scan through the graph
+ * Returns the number of points that changed, inputs included; use
+ * vp_changed() to find them
+ */
+{
+	int i, k, changed = 0;
+	long e = ++g->epoch;
+
+	for(i = 0; i < g->n; i++)
+	{
+		vp_node *p = &g->node[i];
+		int dirty = p->stamp == e;
+
+		if(p->op == VP_INPUT)
+		{
+			changed += dirty;
+			continue;
+		}
+		for(k = 0; k < VP_MAXIN && !dirty; k++)
+		{
+			dirty = p->in[k] >= 0 && g->node[p->in[k]].stamp == e;
+		}
+		if(dirty)
+		{
+			p->value = vp_eval(g, p);
+			g->evals++;
+			changed += vp_moved(p, e);
+		}
+	}
+	return changed;
+}
+
+
+int vp_changed(const vp_graph *g, int i)
+/*
+ * Non zero if point i changed beyond its deadband in the last scan
+ */
+{
+	return g->node[i].stamp == g->epoch;
+}
+
+
+double vp_value(const vp_graph *g, int i)
+/*
+ * Latest value of point i
+ */
+{
+	return g->node[i].value;
+}
+
+
+#endif
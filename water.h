@@ -0,0 +1,237 @@
+/*
+ * water.h
+ *
+ * Hydronic fluid properties: water, ethylene glycol and propylene glycol.
+ *
+ * Properties are evaluated once into a table over temperature and glycol
+ * mass fraction by fluid_init(); lookups are then a bilinear interpolation
+ * with no polynomial or exp evaluation per call, and fluid_props_batch()
+ * serves a whole array of coil or plant operating points.
+ *
+ * Water uses the correlations below.  Glycol mixtures apply mixing rules
+ * to pure glycol fits (ideal volume density, mass weighted cp, Filippov
+ * conductivity, log mass viscosity); they are approximate, a few percent
+ * for density, cp and conductivity and up to about 20% for viscosity.
+ * Use manufacturer data for final pump and coil selection.  Temperatures
+ * below the mixture's freezing point are not checked.
+ *
+ */
+
+#ifndef WATER_H
+#define WATER_H
+#include <math.h>
+
+#define FLUID_WATER 0
+#define FLUID_EG 1			// ethylene glycol - water
+#define FLUID_PG 2			// propylene glycol - water
+
+#define FLUID_T0 -40.0		// first table temperature [degC]
+#define FLUID_DT 1.0		// table temperature step [degC]
+#define FLUID_NT 161		// -40 to 120 degC
+#define FLUID_DX 0.05		// table mass fraction step
+#define FLUID_NX 13			// 0 to 60% glycol
+
+#define FLUID_RHO 0			// density [kg/m^3]
+#define FLUID_CP 1			// specific heat [kJ/kg K]
+#define FLUID_MU 2			// dynamic viscosity [Pa s]
+#define FLUID_K 3			// thermal conductivity [W/m K]
+#define FLUID_NPROP 4
+
+
+typedef struct
+{
+	int fluid;
+	double v[FLUID_NT][FLUID_NX][FLUID_NPROP];
+} fluid_table;
+
+
+double water_density(double T)
+/*
+ * Density of pure water [kg/m^3], Thiesen equation
+ * T = temperature [degC], 0 to 100 C
+ */
+{
+	return 1000 * (1 - (T + 288.9414) / (508929.2 * (T + 68.12963)) * pow(T - 3.9863, 2));
+}
+
+
+// Specific heat of liquid water [kJ/kg K] every 5 C from 0 to 120 C, IAPWS-95
+// at 101.325 kPa and on the saturation line above 100 C
+const double water_cp_tab[25] =
+{
+	4.2199, 4.2052, 4.1955, 4.1888, 4.1841, 4.1813, 4.1798, 4.1794, 4.1795,
+	4.1801, 4.1813, 4.1830, 4.1850, 4.1874, 4.1901, 4.1933, 4.1968, 4.2008,
+	4.2052, 4.2101, 4.2157, 4.2217, 4.2283, 4.2355, 4.2435
+};
+
+
+double water_cp(double T)
+/*
+ * Specific heat of pure water [kJ/kg K], interpolated in water_cp_tab
+ * T = temperature [degC], 0 to 120 C; held at the end values outside
+ */
+{
+	double f = T / 5;
+	int i;
+	if(!(f > 0))
+	{
+		return water_cp_tab[0];
+	}
+	if(f >= 24)
+	{
+		return water_cp_tab[24];
+	}
+	i = (int)f;
+	return water_cp_tab[i] + (f - i) * (water_cp_tab[i + 1] - water_cp_tab[i]);
+}
+
+
+double water_viscosity(double T)
+/*
+ * Dynamic viscosity of pure water [Pa s], Vogel equation
+ * T = temperature [degC], 0 to 100 C
+ */
+{
+	return 2.414E-5 * pow(10, 247.8 / (T + 133.15));
+}
+
+
+double water_conductivity(double T)
+/*
+ * Thermal conductivity of pure water [W/m K]
+ * T = temperature [degC], 0 to 100 C
+ */
+{
+	return 0.5706 + 1.756E-3 * T - 6.46E-6 * pow(T, 2);
+}
+
+
+void fluid_mix(int fluid, double T, double x, double *p)
+/*
+ * Evaluates the four properties of a glycol mixture from the correlations
+ * fluid = FLUID_WATER, FLUID_EG or FLUID_PG
+ * T = temperature [degC]
+ * x = glycol mass fraction (ignored for water)
+ * p = output, indexed by FLUID_RHO, FLUID_CP, FLUID_MU, FLUID_K
+ */
+{
+	double rg, cg, mg, kg;
+	double rw = water_density(T), cw = water_cp(T), mw = water_viscosity(T), kw = water_conductivity(T);
+
+	if(fluid == FLUID_EG)
+	{
+		rg = 1128 - 0.75 * T;
+		cg = 2.32 + 0.0043 * T;
+		mg = exp(-14.635 + 3142 / (T + 273.15));
+		kg = 0.25;
+	}
+	else if(fluid == FLUID_PG)
+	{
+		rg = 1051 - 0.75 * T;
+		cg = 2.43 + 0.0045 * T;
+		mg = exp(-15.802 + 3703 / (T + 273.15));
+		kg = 0.20;
+	}
+	else
+	{
+		x = 0;
+		rg = rw;
+		cg = cw;
+		mg = mw;
+		kg = kw;
+	}
+
+	p[FLUID_RHO] = 1 / ((1 - x) / rw + x / rg);
+	p[FLUID_CP] = (1 - x) * cw + x * cg;
+	p[FLUID_MU] = exp((1 - x) * log(mw) + x * log(mg));
+	p[FLUID_K] = (1 - x) * kw + x * kg - 0.72 * x * (1 - x) * (kw - kg);
+}
+
+
+void fluid_init(fluid_table *t, int fluid)
+/*
+ * Fills the property table of a fluid, done once at start up
+ */
+{
+	int i, j;
+	t->fluid = fluid;
+	for(i = 0; i < FLUID_NT; i++)
+	{
+		for(j = 0; j < FLUID_NX; j++)
+		{
+			fluid_mix(fluid, FLUID_T0 + i * FLUID_DT, j * FLUID_DX, t->v[i][j]);
+		}
+	}
+}
+
+
+double fluid_prop(const fluid_table *t, int prop, double T, double x)
+/*
+ * Interpolates one property
+ * prop = FLUID_RHO, FLUID_CP, FLUID_MU or FLUID_K
+ * T = temperature [degC], clamped to the table range
+ * x = glycol mass fraction, clamped to the table range
+ */
+{
+	double fi = (T - FLUID_T0) / FLUID_DT;
+	double fj = x / FLUID_DX;
+	int i, j;
+
+	fi = fmin(fmax(fi, 0), FLUID_NT - 1.000001);
+	fj = fmin(fmax(fj, 0), FLUID_NX - 1.000001);
+	i = (int)fi;
+	j = (int)fj;
+	fi -= i;
+	fj -= j;
+	return (1 - fi) * ((1 - fj) * t->v[i][j][prop] + fj * t->v[i][j + 1][prop])
+			+ fi * ((1 - fj) * t->v[i + 1][j][prop] + fj * t->v[i + 1][j + 1][prop]);
+}
+
+
+void fluid_props_batch(const fluid_table *t, const double *T, double x, int n,
+		double *rho, double *cp, double *mu, double *k)
+/*
+ * Interpolates all four properties for n temperatures at one concentration
+ * T = temperatures [degC]
+ * x = glycol mass fraction
+ * rho, cp, mu, k = outputs of length n, any of them may be NULL
+ */
+{
+	int i, a, j;
+	double fj = fmin(fmax(x / FLUID_DX, 0), FLUID_NX - 1.000001);
+	j = (int)fj;
+	fj -= j;
+
+	for(i = 0; i < n; i++)
+	{
+		double p[FLUID_NPROP];
+		double fi = fmin(fmax((T[i] - FLUID_T0) / FLUID_DT, 0), FLUID_NT - 1.000001);
+		int r = (int)fi;
+		const double *v00 = t->v[r][j], *v01 = t->v[r][j + 1];
+		const double *v10 = t->v[r + 1][j], *v11 = t->v[r + 1][j + 1];
+		fi -= r;
+		for(a = 0; a < FLUID_NPROP; a++)
+		{
+			p[a] = (1 - fi) * ((1 - fj) * v00[a] + fj * v01[a]) + fi * ((1 - fj) * v10[a] + fj * v11[a]);
+		}
+		if(rho)
+		{
+			rho[i] = p[FLUID_RHO];
+		}
+		if(cp)
+		{
+			cp[i] = p[FLUID_CP];
+		}
+		if(mu)
+		{
+			mu[i] = p[FLUID_MU];
+		}
+		if(k)
+		{
+			k[i] = p[FLUID_K];
+		}
+	}
+}
+
+
+#endif